@@ -0,0 +1,66 @@
+#include "./audio_out.h"
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include <cstring>
+
+namespace {
+// 3 x 512 samples, about 35 ms queued in the device on top of the ring
+constexpr int buffers = 3;
+constexpr UInt32 bufferSamples = 512;
+
+void refill(void *user, AudioQueueRef queue, AudioQueueBufferRef buffer) {
+  auto *sound = static_cast<Sound *>(user);
+  sound->pull(static_cast<int16_t *>(buffer->mAudioData), bufferSamples);
+  buffer->mAudioDataByteSize = bufferSamples * sizeof(int16_t);
+  AudioQueueEnqueueBuffer(queue, buffer, 0, nullptr);
+}
+} // namespace
+
+AudioOut::~AudioOut() { stop(); }
+
+bool AudioOut::start() {
+  AudioStreamBasicDescription format = {};
+  format.mSampleRate = Sound::sampleRate;
+  format.mFormatID = kAudioFormatLinearPCM;
+  format.mFormatFlags =
+      kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
+  format.mBytesPerPacket = sizeof(int16_t);
+  format.mFramesPerPacket = 1;
+  format.mBytesPerFrame = sizeof(int16_t);
+  format.mChannelsPerFrame = 1;
+  format.mBitsPerChannel = 16;
+
+  // No run loop: callbacks come on the queue's internal thread
+  AudioQueueRef q = nullptr;
+  if (AudioQueueNewOutput(&format, refill, &sound, nullptr, nullptr, 0, &q) !=
+      noErr) {
+    return false;
+  }
+
+  // Prime with silence so startup doesn't count as underruns
+  for (int i = 0; i < buffers; ++i) {
+    AudioQueueBufferRef buffer = nullptr;
+    AudioQueueAllocateBuffer(q, bufferSamples * sizeof(int16_t), &buffer);
+    memset(buffer->mAudioData, 0, bufferSamples * sizeof(int16_t));
+    buffer->mAudioDataByteSize = bufferSamples * sizeof(int16_t);
+    AudioQueueEnqueueBuffer(q, buffer, 0, nullptr);
+  }
+
+  if (AudioQueueStart(q, nullptr) != noErr) {
+    AudioQueueDispose(q, true);
+    return false;
+  }
+  queue = q;
+  return true;
+}
+
+void AudioOut::stop() {
+  if (queue == nullptr) {
+    return;
+  }
+  auto q = static_cast<AudioQueueRef>(queue);
+  AudioQueueStop(q, true);
+  AudioQueueDispose(q, true);
+  queue = nullptr;
+}
@@ -0,0 +1,20 @@
+#ifndef audio_out_h
+#define audio_out_h
+#include "./sound.h"
+
+/* Plays a Sound on the default output device through an AudioQueue. The
+ * queue's own thread is the consumer side of the sound's ring.
+ */
+struct AudioOut {
+  explicit AudioOut(Sound &sound) : sound(sound) {}
+  ~AudioOut();
+
+  bool start();
+  void stop();
+
+private:
+  Sound &sound;
+  void *queue = nullptr;
+};
+
+#endif /* audio_out_h */
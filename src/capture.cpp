@@ -0,0 +1,350 @@
+#include "./capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+const char magic[4] = {'S', 'I', 'C', 'V'};
+const char indexMagic[4] = {'S', 'I', 'D', 'X'};
+const uint16_t version = 1;
+enum : uint8_t { keyframe = 1, delta = 2 };
+// Record header: kind, machine frame, size
+const size_t recordHeader = 1 + 8 + 4;
+// The encoder is woken once this many frames are queued, or finds them
+// when it wakes up on its own, so push() rarely has a thread to wake
+const size_t batch = 8;
+const auto idle = std::chrono::milliseconds(20);
+// Y4M picture, upright
+const int width = 224, height = 256;
+
+template <typename T> void putLE(std::vector<uint8_t> &out, T v) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out.push_back((v >> (8 * i)) & 0xff);
+  }
+}
+
+template <typename T> T getLE(const uint8_t *p) {
+  T v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    v |= static_cast<T>(p[i]) << (8 * i);
+  }
+  return v;
+}
+
+void putVarint(std::vector<uint8_t> &out, size_t v) {
+  while (v >= 0x80) {
+    out.push_back((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(v);
+}
+
+bool getVarint(const uint8_t *&p, const uint8_t *end, size_t *v) {
+  *v = 0;
+  for (int shift = 0; p < end && shift < 35; shift += 7) {
+    uint8_t b = *p++;
+    *v |= static_cast<size_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Runs of { unchanged, n, n XOR bytes } from prev to cur
+void encodeXor(const uint8_t *prev, const uint8_t *cur, size_t n,
+               std::vector<uint8_t> &out) {
+  size_t i = 0;
+  while (i < n) {
+    size_t same = i;
+    while (same < n && prev[same] == cur[same]) {
+      ++same;
+    }
+    // A changed run ends at two unchanged bytes in a row, which cost
+    // more to copy than to start a new run for
+    size_t end = same;
+    while (end < n && !(prev[end] == cur[end] &&
+                        (end + 1 == n || prev[end + 1] == cur[end + 1]))) {
+      ++end;
+    }
+    putVarint(out, same - i);
+    putVarint(out, end - same);
+    for (size_t j = same; j < end; ++j) {
+      out.push_back(prev[j] ^ cur[j]);
+    }
+    i = end;
+  }
+}
+
+bool decodeXor(const uint8_t *p, const uint8_t *end, uint8_t *frame,
+               size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    size_t same = 0, changed = 0;
+    if (!getVarint(p, end, &same) || !getVarint(p, end, &changed) ||
+        same + changed > n - i || changed > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    i += same;
+    for (size_t j = 0; j < changed; ++j) {
+      frame[i++] ^= *p++;
+    }
+  }
+  return p == end;
+}
+
+// The video RAM turned upright, one byte per pixel
+void y4mPicture(const uint8_t *vram, uint8_t *out) {
+  for (int x = 0; x < width; ++x) {
+    for (int byte = 0; byte < 32; ++byte) {
+      uint8_t v = vram[x * 32 + byte];
+      for (int bit = 0; bit < 8; ++bit) {
+        int y = height - 1 - (byte * 8 + bit);
+        out[y * width + x] = (v >> bit) & 1 ? 0xff : 0x00;
+      }
+    }
+  }
+}
+} // namespace
+
+bool VideoCapture::start(const char *path, const Config &config) {
+  stop();
+  this->config = config;
+  if (this->config.keyframeInterval == 0) {
+    this->config.keyframeInterval = 1;
+  }
+  file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  if (config.y4mPath != nullptr) {
+    y4m = fopen(config.y4mPath, "wb");
+    if (y4m == nullptr) {
+      fclose(file);
+      file = nullptr;
+      return false;
+    }
+    fprintf(y4m, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 Cmono\n", width, height);
+  }
+
+  std::vector<uint8_t> h(magic, magic + 4);
+  putLE<uint16_t>(h, version);
+  putLE<uint16_t>(h, 0);
+  putLE<uint32_t>(h, frameBytes);
+  putLE<uint32_t>(h, this->config.keyframeInterval);
+  failed = fwrite(h.data(), 1, h.size(), file) != h.size();
+  bytes = h.size();
+
+  frames = keyframes = dropped = 0;
+  previous.assign(frameBytes, 0);
+  index.clear();
+  queue.clear();
+  stopping = false;
+  encoder = std::thread([this] { encode(); });
+  return true;
+}
+
+void VideoCapture::push(const Machine &m) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (queue.size() >= config.queueFrames) {
+    dropped++;
+    return;
+  }
+  Frame f;
+  f.number = m.frames;
+  if (!spare.empty()) {
+    f.vram = std::move(spare.back());
+    spare.pop_back();
+  }
+  f.vram.assign(m.vram(), m.vram() + frameBytes);
+  queue.push_back(std::move(f));
+  if (queue.size() == batch) {
+    lock.unlock();
+    wake.notify_one();
+  }
+}
+
+void VideoCapture::encode() {
+  std::deque<Frame> taken;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait_for(lock, idle,
+                    [this] { return stopping || queue.size() >= batch; });
+      if (queue.empty() && stopping) {
+        return; // everything is written
+      }
+      taken.swap(queue);
+    }
+
+    bool ok = true;
+    for (const Frame &f : taken) {
+      ok = write(f) && ok;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    failed = failed || !ok;
+    for (Frame &f : taken) {
+      spare.push_back(std::move(f.vram));
+    }
+    taken.clear();
+  }
+}
+
+bool VideoCapture::write(const Frame &f) {
+  bool key = frames % config.keyframeInterval == 0;
+  if (key) {
+    index.push_back({static_cast<uint32_t>(frames), bytes});
+    previous.assign(frameBytes, 0);
+    keyframes++;
+  }
+
+  record.clear();
+  record.push_back(key ? keyframe : delta);
+  putLE<uint64_t>(record, f.number);
+  putLE<uint32_t>(record, 0);
+  encodeXor(previous.data(), f.vram.data(), frameBytes, record);
+  uint32_t size = record.size() - recordHeader;
+  for (size_t i = 0; i < 4; ++i) {
+    record[9 + i] = (size >> (8 * i)) & 0xff;
+  }
+  previous = f.vram;
+  frames++;
+  bytes += record.size();
+  bool ok = fwrite(record.data(), 1, record.size(), file) == record.size();
+
+  if (y4m != nullptr) {
+    picture.resize(width * height);
+    y4mPicture(f.vram.data(), picture.data());
+    ok = fputs("FRAME\n", y4m) >= 0 &&
+         fwrite(picture.data(), 1, picture.size(), y4m) == picture.size() &&
+         ok;
+  }
+  return ok;
+}
+
+bool VideoCapture::stop() {
+  if (file == nullptr) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  encoder.join();
+
+  std::vector<uint8_t> tail;
+  for (const auto &k : index) {
+    putLE<uint32_t>(tail, k.first);
+    putLE<uint64_t>(tail, k.second);
+  }
+  putLE<uint32_t>(tail, static_cast<uint32_t>(frames));
+  putLE<uint32_t>(tail, static_cast<uint32_t>(index.size()));
+  tail.insert(tail.end(), indexMagic, indexMagic + 4);
+  bool ok =
+      !failed && fwrite(tail.data(), 1, tail.size(), file) == tail.size();
+  bytes += tail.size();
+
+  ok = fclose(file) == 0 && ok;
+  file = nullptr;
+  if (y4m != nullptr) {
+    ok = fclose(y4m) == 0 && ok;
+    y4m = nullptr;
+  }
+  spare.clear();
+  return ok;
+}
+
+VideoReader::~VideoReader() {
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+bool VideoReader::open(const char *path) {
+  file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint8_t h[16], t[12];
+  bool ok = fread(h, 1, sizeof(h), file) == sizeof(h) &&
+            memcmp(h, magic, 4) == 0 && getLE<uint16_t>(h + 4) == version &&
+            getLE<uint32_t>(h + 8) == VideoCapture::frameBytes &&
+            fseek(file, -static_cast<long>(sizeof(t)), SEEK_END) == 0 &&
+            fread(t, 1, sizeof(t), file) == sizeof(t) &&
+            memcmp(t + 8, indexMagic, 4) == 0;
+  if (!ok) {
+    return false;
+  }
+
+  count = getLE<uint32_t>(t);
+  uint32_t keyframes = getLE<uint32_t>(t + 4);
+  if (keyframes > count) {
+    return false;
+  }
+  std::vector<uint8_t> entries(keyframes * 12);
+  long at = -static_cast<long>(sizeof(t) + entries.size());
+  if (fseek(file, at, SEEK_END) != 0 ||
+      fread(entries.data(), 1, entries.size(), file) != entries.size()) {
+    return false;
+  }
+  index.clear();
+  for (uint32_t i = 0; i < keyframes; ++i) {
+    index.push_back({getLE<uint32_t>(&entries[i * 12]),
+                     getLE<uint64_t>(&entries[i * 12 + 4])});
+  }
+  current.assign(VideoCapture::frameBytes, 0);
+  return count == 0 || (!index.empty() && index[0].first == 0 && seek(0));
+}
+
+bool VideoReader::seek(uint32_t n) {
+  if (n >= count) {
+    return false;
+  }
+  // The last keyframe at or before n
+  size_t k = 0;
+  while (k + 1 < index.size() && index[k + 1].first <= n) {
+    ++k;
+  }
+  if (fseek(file, static_cast<long>(index[k].second), SEEK_SET) != 0) {
+    return false;
+  }
+  next = index[k].first;
+  while (next < n) {
+    if (!read(current.data())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VideoReader::read(uint8_t *vram, uint64_t *machineFrame) {
+  uint8_t h[recordHeader];
+  if (next >= count || fread(h, 1, sizeof(h), file) != sizeof(h) ||
+      (h[0] != keyframe && h[0] != delta)) {
+    return false;
+  }
+  uint32_t size = getLE<uint32_t>(h + 9);
+  record.resize(size);
+  if (fread(record.data(), 1, size, file) != size) {
+    return false;
+  }
+  if (h[0] == keyframe) {
+    std::fill(current.begin(), current.end(), 0);
+  }
+  if (!decodeXor(record.data(), record.data() + size, current.data(),
+                 current.size())) {
+    return false;
+  }
+  if (vram != current.data()) {
+    memcpy(vram, current.data(), current.size());
+  }
+  if (machineFrame != nullptr) {
+    *machineFrame = getLE<uint64_t>(h + 1);
+  }
+  next++;
+  return true;
+}
@@ -0,0 +1,110 @@
+#ifndef capture_h
+#define capture_h
+#include "./machine.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Records the screen in the background. push() copies the video RAM into
+ * a bounded queue and returns; an encoder thread writes each frame as the
+ * XOR with the frame before it, run-length coded, which leaves little of a
+ * mostly still 1bpp screen. The encoder takes queued frames in batches,
+ * so push() is a copy under a lock and rarely wakes a thread. Every
+ * keyframeInterval frames the frame is coded on its own (XOR with a blank
+ * screen) so a reader can seek to it. When the queue is full the frame is
+ * dropped and counted, never waited for.
+ *
+ * File layout (little endian):
+ *   "SICV" | u16 version | u16 reserved | u32 frame bytes
+ *   u32 keyframe interval
+ *   records: u8 kind (1 keyframe, 2 delta) | u64 machine frame
+ *            u32 size | size bytes
+ *   index: keyframes * { u32 frame, u64 offset } | u32 frames
+ *          u32 keyframes | "SIDX"
+ * Frame numbers in the index count the frames in the file. A record is
+ * runs of { varint unchanged bytes, varint n, n XOR bytes } covering the
+ * frame.
+ *
+ * Optionally every frame also goes to a Y4M file (monochrome, upright
+ * 224x256, 60 fps) for standard tools.
+ */
+struct VideoCapture {
+  static constexpr size_t frameBytes = 0x4000 - 0x2400;
+
+  struct Config {
+    uint32_t keyframeInterval = 300;
+    size_t queueFrames = 120;
+    const char *y4mPath = nullptr;
+  };
+
+  VideoCapture() = default;
+  VideoCapture(const VideoCapture &) = delete;
+  VideoCapture &operator=(const VideoCapture &) = delete;
+  ~VideoCapture() { stop(); }
+
+  bool start(const char *path, const Config &config);
+  bool start(const char *path) { return start(path, Config()); }
+  // From the emulation thread, once a frame is finished
+  void push(const Machine &m);
+  // Encode what is queued, write the index and close. False if a write
+  // failed at any point.
+  bool stop();
+
+  bool running() const { return file != nullptr; }
+
+  // Written by the encoder; read them after stop()
+  uint64_t frames = 0, keyframes = 0, bytes = 0;
+  // Counted by push()
+  uint64_t dropped = 0;
+
+private:
+  struct Frame {
+    uint64_t number = 0;
+    std::vector<uint8_t> vram;
+  };
+
+  Config config;
+  FILE *file = nullptr, *y4m = nullptr;
+  std::thread encoder;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Frame> queue;
+  std::vector<std::vector<uint8_t>> spare; // buffers to reuse
+  bool stopping = false;
+  bool failed = false;
+
+  // Encoder thread state
+  std::vector<uint8_t> previous, record, picture;
+  std::vector<std::pair<uint32_t, uint64_t>> index;
+
+  void encode();
+  bool write(const Frame &f);
+};
+
+/* Reads a VideoCapture file frame by frame, or from any frame on by
+ * seeking to the keyframe before it.
+ */
+struct VideoReader {
+  ~VideoReader();
+
+  bool open(const char *path);
+  uint32_t frames() const { return count; }
+
+  // The next read() returns frame n
+  bool seek(uint32_t n);
+  // The next frame's video RAM into vram (VideoCapture::frameBytes)
+  bool read(uint8_t *vram, uint64_t *machineFrame = nullptr);
+
+private:
+  FILE *file = nullptr;
+  uint32_t count = 0, next = 0;
+  std::vector<std::pair<uint32_t, uint64_t>> index;
+  std::vector<uint8_t> current, record;
+};
+
+#endif /* capture_h */
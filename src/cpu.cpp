@@ -13,15 +13,8 @@ void intel8080::NOP() {
   cycles += 4;
 }
 
-void intel8080::LXI(uint8_t *reg1, uint8_t *reg2) {
-  *reg1 = memory.at(pc + 2);
-  *reg2 = memory.at(pc + 1);
-  pc += 3;
-  cycles += 10;
-}
-
 void intel8080::LXI(uint16_t *reg) {
-  *reg = (memory.at(pc + 2) << 8) | memory.at(pc + 1);
+  *reg = (read(pc + 2) << 8) | read(pc + 1);
   pc += 3;
   cycles += 10;
 }
@@ -38,8 +31,8 @@ void intel8080::DCR(uint8_t *reg, uint8_t opCycles) {
   cycles += opCycles;
 }
 
-void intel8080::STAX(const uint8_t *reg1, const uint8_t *reg2) {
-  memory.at((*reg1 << 8) | *reg2) = A;
+template <typename F> void intel8080::STAX(uint16_t adr) {
+  store<F>(adr, A);
   pc += 1;
   cycles += 7;
 }
@@ -50,15 +43,6 @@ void intel8080::INX(uint16_t *reg) {
   cycles += 5;
 }
 
-void intel8080::INX(uint8_t *reg1, uint8_t *reg2) {
-  uint16_t res = ((*reg1 << 8) | *reg2) + 1;
-  *reg1 = res >> 8;
-  *reg2 = res & 0x00FF;
-
-  pc += 1;
-  cycles += 5;
-}
-
 void intel8080::MOV(uint8_t *reg1, const uint8_t *reg2, uint8_t opCycles) {
   *reg1 = *reg2;
   pc += 1;
@@ -84,42 +68,22 @@ void intel8080::DCX(uint16_t *reg) {
   cycles += 5;
 }
 
-void intel8080::DCX(uint8_t *reg1, uint8_t *reg2) {
-  uint16_t res = ((*reg1 << 8) | L) - 1;
-  *reg1 = res >> 8;
-  *reg2 = res & 0x00FF;
-
-  pc += 1;
-  cycles += 5;
-}
-
 void intel8080::MVI(uint8_t *reg, uint8_t opCycles) {
-  *reg = memory.at(pc + 1);
+  *reg = read(pc + 1);
 
   pc += 2;
   cycles += opCycles;
 }
 
-void intel8080::DAD(const uint8_t *reg1, const uint8_t *reg2) {
-  uint16_t res = ((H << 8) | L) + ((*reg1 << 8) | *reg2);
-  H = res >> 8;
-  L = res & 0x00FF;
-
-  pc += 1;
-  cycles += 10;
-}
-
 void intel8080::DAD(const uint16_t *reg) {
-  uint16_t res = ((H << 8) | L) + *reg;
-  H = res >> 8;
-  L = res & 0x00FF;
+  HL += *reg;
 
   pc += 1;
   cycles += 10;
 }
 
-void intel8080::LDAX(const uint8_t *reg1, const uint8_t *reg2) {
-  A = memory.at((*reg1 << 8) | *reg2);
+template <typename F> void intel8080::LDAX(uint16_t adr) {
+  A = load<F>(adr);
   pc += 1;
   cycles += 7;
 }
@@ -236,9 +200,9 @@ void intel8080::CMP(const uint8_t *reg, uint8_t opCycles) {
   cycles += opCycles;
 }
 
-void intel8080::ret(bool condition) {
+template <typename F> void intel8080::ret(bool condition) {
   if (condition) {
-    pc = (memory.at((sp + 1)) << 8) | memory.at(sp);
+    pc = (load<F>(sp + 1) << 8) | load<F>(sp);
     sp += 2;
     cycles += 10;
   } else {
@@ -247,22 +211,22 @@ void intel8080::ret(bool condition) {
   }
 }
 
-void intel8080::RST(const uint8_t num) {
-  memory.at(sp - 1) = (pc >> 8) & 0xff;
-  memory.at(sp - 2) = pc & 0xff;
+template <typename F> void intel8080::RST(const uint8_t num) {
+  store<F>(sp - 1, (pc >> 8) & 0xff);
+  store<F>(sp - 2, pc & 0xff);
   sp -= 2;
 
   pc = num;
   cycles += 11;
 }
 
-void intel8080::call(bool condition) {
+template <typename F> void intel8080::call(bool condition) {
   if (condition) {
-    memory.at(sp - 1) = ((pc + 3) >> 8) & 0xFF;
-    memory.at(sp - 2) = ((pc + 3) & 0xFF);
+    store<F>(sp - 1, ((pc + 3) >> 8) & 0xFF);
+    store<F>(sp - 2, ((pc + 3) & 0xFF));
     sp -= 2;
 
-    pc = (memory.at(pc + 2) << 8) | memory.at(pc + 1);
+    pc = (read(pc + 2) << 8) | read(pc + 1);
     cycles += 17;
   } else {
     pc += 3;
@@ -286,7 +250,7 @@ void intel8080::enableDisableInterrupts(bool operation) {
 
 void intel8080::jump(bool condition) {
   if (condition) {
-    pc = (memory.at(pc + 1) | memory.at(pc + 2) << 8);
+    pc = (read(pc + 1) | read(pc + 2) << 8);
   } else {
     pc += 3;
   }
@@ -294,23 +258,21 @@ void intel8080::jump(bool condition) {
   cycles += 10;
 }
 
-void intel8080::exchange(uint8_t *a1, uint8_t *a2, uint8_t *b1, uint8_t *b2,
-                         uint8_t opCycles) {
-  std::swap(*a1, *b1);
-  std::swap(*a2, *b2);
+void intel8080::exchange(uint16_t *a, uint16_t *b, uint8_t opCycles) {
+  std::swap(*a, *b);
 
   pc += 1;
   cycles += opCycles;
 }
 
-void intel8080::storeLoadHL(bool storing) {
-  uint16_t adr = (memory.at(pc + 2) << 8) | memory.at(pc + 1);
+template <typename F> void intel8080::storeLoadHL(bool storing) {
+  uint16_t adr = (read(pc + 2) << 8) | read(pc + 1);
   if (storing) { // Store
-    memory.at(adr) = L;
-    memory.at(adr + 1) = H;
+    store<F>(adr, L);
+    store<F>(adr + 1, H);
   } else { // Load
-    L = memory.at(adr);
-    H = memory.at(adr + 1);
+    L = load<F>(adr);
+    H = load<F>(adr + 1);
   }
   pc += 3;
   cycles += 16;
@@ -320,6 +282,17 @@ void intel8080::putHL(uint16_t *r) {
   /* if r is PC pc += 1 doesn't matter
    * if r is SP pc will advance */
   pc += 1;
-  *r = (H << 8) | L;
+  *r = HL;
   cycles += 5;
 }
+
+#define instantiate(F)                                                         \
+  template void intel8080::STAX<F>(uint16_t);                                  \
+  template void intel8080::LDAX<F>(uint16_t);                                  \
+  template void intel8080::ret<F>(bool);                                       \
+  template void intel8080::RST<F>(const uint8_t);                              \
+  template void intel8080::call<F>(bool);                                      \
+  template void intel8080::storeLoadHL<F>(bool);
+instantiate(ProductionFeatures)
+instantiate(DebugFeatures)
+#undef instantiate
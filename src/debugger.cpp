@@ -0,0 +1,184 @@
+#include "./debugger.h"
+#include "./disasm.h"
+
+namespace {
+constexpr uint64_t frameCycles = 2 * Machine::halfFrameCycles;
+} // namespace
+
+Debugger::Debugger(Machine &m) : m(m) {}
+
+Debugger::~Debugger() {
+  if (m.cpu.hooks == this) {
+    m.cpu.hooks = next;
+  }
+}
+
+void Debugger::clear() {
+  breakpoints.reset();
+  readWatch.reset();
+  writeWatch.reset();
+  inBreak.reset();
+  outBreak.reset();
+}
+
+bool Debugger::active() const {
+  return breakpoints.any() || readWatch.any() || writeWatch.any() ||
+         inBreak.any() || outBreak.any();
+}
+
+void Debugger::trigger(Stop why, uint16_t adr, uint8_t val) {
+  // The first access of the instruction is the one reported
+  if (!triggered) {
+    triggered = true;
+    pending = why;
+    stopAdr = adr;
+    stopValue = val;
+  }
+}
+
+void Debugger::before(const intel8080 &cpu) {
+  if (next != nullptr) {
+    next->before(cpu);
+  }
+}
+
+void Debugger::after(const intel8080 &cpu) {
+  if (next != nullptr) {
+    next->after(cpu);
+  }
+}
+
+void Debugger::onRead(uint16_t adr, uint8_t val) {
+  if (next != nullptr) {
+    next->onRead(adr, val);
+  }
+  if (readWatch[adr]) {
+    trigger(Stop::Read, adr, val);
+  }
+}
+
+void Debugger::onWrite(uint16_t adr, uint8_t val) {
+  if (next != nullptr) {
+    next->onWrite(adr, val);
+  }
+  if (writeWatch[adr]) {
+    trigger(Stop::Write, adr, val);
+  }
+}
+
+void Debugger::onIn(uint8_t port) {
+  if (next != nullptr) {
+    next->onIn(port);
+  }
+  if (inBreak[port]) {
+    trigger(Stop::In, port, 0);
+  }
+}
+
+void Debugger::onOut(uint8_t port, uint8_t val) {
+  if (next != nullptr) {
+    next->onOut(port, val);
+  }
+  if (outBreak[port]) {
+    trigger(Stop::Out, port, val);
+  }
+}
+
+// done() is asked after every instruction and returns true to stop with
+// Stop::Step
+template <typename Done>
+Debugger::Stop Debugger::runUntil(uint64_t maxFrames, Done done) {
+  bool hooked = readWatch.any() || writeWatch.any() || inBreak.any() ||
+                outBreak.any();
+  // Whatever was installed stays in the chain and comes back afterwards
+  CpuHooks *previous = m.cpu.hooks;
+  if (hooked) {
+    next = previous;
+    m.cpu.hooks = this;
+  }
+  triggered = false;
+
+  Stop stop = Stop::Limit;
+  uint64_t start = now();
+  // The first instruction runs even if it has a breakpoint: that is
+  // usually the one we stopped at
+  for (bool first = true; now() - start < maxFrames * frameCycles;
+       first = false) {
+    if (!first && breakpoints[m.cpu.pc]) {
+      stop = Stop::Breakpoint;
+      stopAdr = m.cpu.pc;
+      break;
+    }
+    m.step();
+    if (triggered) {
+      stop = pending;
+      break;
+    }
+    if (done()) {
+      stop = Stop::Step;
+      break;
+    }
+  }
+
+  m.cpu.hooks = previous;
+  next = nullptr;
+  return stop;
+}
+
+Debugger::Stop Debugger::step() {
+  return runUntil(1, [] { return true; });
+}
+
+Debugger::Stop Debugger::stepOver(uint64_t maxFrames) {
+  uint8_t op = m.cpu.read(m.cpu.pc);
+  if (!disasm::isCall(op)) {
+    return step();
+  }
+  // Back right after the call, on the same stack level (not in a
+  // recursive call that happens to pass there)
+  uint16_t next = m.cpu.pc + disasm::opcode(op).length;
+  uint16_t sp = m.cpu.sp;
+  return runUntil(maxFrames, [&] {
+    return m.cpu.pc == next && m.cpu.sp >= sp;
+  });
+}
+
+Debugger::Stop Debugger::finish(uint64_t maxFrames) {
+  // sp only moves above where it is now once the routine's return address
+  // has been popped: pushes and pops in between balance out
+  uint16_t sp = m.cpu.sp;
+  Stop s = runUntil(maxFrames, [&] { return m.cpu.sp > sp; });
+  return s == Stop::Step ? Stop::Return : s;
+}
+
+Debugger::Stop Debugger::run(uint64_t maxFrames) {
+  if (active()) {
+    return runUntil(maxFrames, [] { return false; });
+  }
+  // Nothing can stop it: plain frames on the production core
+  for (uint64_t f = 0; f < maxFrames; ++f) {
+    m.stepFrame();
+  }
+  return Stop::Limit;
+}
+
+const char *stopName(Debugger::Stop s) {
+  switch (s) {
+  case Debugger::Stop::Step:
+    return "step";
+  case Debugger::Stop::Breakpoint:
+    return "breakpoint";
+  case Debugger::Stop::Read:
+    return "read watchpoint";
+  case Debugger::Stop::Write:
+    return "write watchpoint";
+  case Debugger::Stop::In:
+    return "IN breakpoint";
+  case Debugger::Stop::Out:
+    return "OUT breakpoint";
+  case Debugger::Stop::Return:
+    return "returned";
+  default:
+    return "frame limit";
+  }
+}
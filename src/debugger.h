@@ -0,0 +1,70 @@
+#ifndef debugger_h
+#define debugger_h
+#include "./machine.h"
+
+#include <bitset>
+#include <cstdint>
+
+/* Breakpoints and watchpoints on a Machine. PC breakpoints and memory
+ * watchpoints are bitmaps over the 64 KB address space, port breakpoints
+ * over the 256 ports.
+ *
+ * With nothing set, run() steps whole frames on the production core, so an
+ * idle debugger costs nothing. PC breakpoints alone are checked between
+ * instructions, still on the production core. Watchpoints and port
+ * breakpoints make it install itself as intel8080::hooks for the duration
+ * of the command, so the debug core reports every data access ((HL)
+ * operands, STAX, SHLD, pushes...) and IN/OUT; those stop after the
+ * instruction that triggered them. Hooks already installed (a Profiler,
+ * a Tracer) are passed every event meanwhile and put back afterwards.
+ */
+struct Debugger : CpuHooks {
+  enum class Stop { Step, Breakpoint, Read, Write, In, Out, Return, Limit };
+
+  explicit Debugger(Machine &m);
+  ~Debugger() override;
+
+  std::bitset<65536> breakpoints;
+  std::bitset<65536> readWatch, writeWatch;
+  std::bitset<256> inBreak, outBreak;
+
+  void clear();
+  // Anything set
+  bool active() const;
+
+  // Each returns why it stopped. maxFrames bounds the run in emulated time.
+  Stop step();
+  // Like step, but runs through CALL, Ccc and RST
+  Stop stepOver(uint64_t maxFrames);
+  // Until the return address of the current routine is popped
+  Stop finish(uint64_t maxFrames);
+  Stop run(uint64_t maxFrames);
+
+  // What the last stop was about: breakpoint or accessed address, or port;
+  // and the byte read, written or sent
+  uint16_t stopAdr = 0;
+  uint8_t stopValue = 0;
+
+  void before(const intel8080 &cpu) override;
+  void after(const intel8080 &cpu) override;
+  void onRead(uint16_t adr, uint8_t val) override;
+  void onWrite(uint16_t adr, uint8_t val) override;
+  void onIn(uint8_t port) override;
+  void onOut(uint8_t port, uint8_t val) override;
+
+private:
+  Machine &m;
+  // The hooks it replaced while installed
+  CpuHooks *next = nullptr;
+  // Set by the hooks during an instruction
+  bool triggered = false;
+  Stop pending = Stop::Limit;
+
+  void trigger(Stop why, uint16_t adr, uint8_t val);
+  uint64_t now() const { return m.totalCycles + m.cpu.cycles; }
+  template <typename Done> Stop runUntil(uint64_t maxFrames, Done done);
+};
+
+const char *stopName(Debugger::Stop s);
+
+#endif /* debugger_h */
@@ -0,0 +1,28 @@
+#ifndef disasm_h
+#define disasm_h
+#include "./emu.h"
+
+#include <cstdint>
+#include <string>
+
+/* Intel 8080 mnemonics and instruction lengths. Undocumented opcodes are
+ * shown with a leading '*' and the instruction they behave like.
+ */
+namespace disasm {
+struct Opcode {
+  const char *format; // printf format taking the operand, if any
+  uint8_t length;     // 1-3 bytes
+};
+
+const Opcode &opcode(uint8_t op);
+// CALL, Ccc and RST (and the undocumented CALLs): push a return address and
+// jump
+bool isCall(uint8_t op);
+
+// e.g. "MVI B,#$12", "JMP $1a32"
+std::string format(uint8_t op, uint8_t lo, uint8_t hi);
+// The instruction at adr in cpu's memory
+std::string format(const intel8080 &cpu, uint16_t adr);
+} // namespace disasm
+
+#endif /* disasm_h */
@@ -1,6 +1,13 @@
+#include "./audio_out.h"
+#include "./capture.h"
 #include "./connection.h"
 #include "./emu.h"
+#include "./machine.h"
 #include "./display.h"
+#include "./frame_ring.h"
+#include "./frameskip.h"
+#include "./perf.h"
+#include "./sound.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -11,64 +18,34 @@
 #include <OpenGL/gl.h>
 #include <OpenGL/OpenGL.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <vector>
 
-intel8080 i8080;
+Machine machine;
+intel8080 &i8080 = machine.cpu;
+Sound sound;
+AudioOut audioOut(sound);
 Display display(224, 256, "Space Invaders");
-
-void loadRom(const char *file, int offset) {
-  FILE *ROM = fopen(file, "rb");
-  fseek(ROM, 0, SEEK_END);
-  uint64_t size = ftell(ROM);
-  rewind(ROM);
-
-  // Allocate memory
-  std::vector<uint8_t> buffer(size);
-
-  // Copy file to buffer
-  fread(buffer.data(), 1, size, ROM);
-
-  std::copy(buffer.begin(), buffer.end(), i8080.memory.begin() + offset);
-  fclose(ROM);
-}
-
-void loadRomZip(zip *z, const char *name, int offset) {
-  struct zip_stat st = {};
-  zip_stat_init(&st);
-  zip_stat(z, name, 0, &st);
-
-  zip_file *f = zip_fopen(z, name, 0);
-  std::vector<uint8_t> buffer(st.size);
-  zip_fread(f, buffer.data(), st.size);
-
-  // Copy file to buffer
-  std::copy(buffer.begin(), buffer.end(), i8080.memory.begin() + offset);
-
-  zip_fclose(f);
-}
-
-#define op(id, oper)                                                           \
-  case id:                                                                     \
-    i8080.oper;                                                                \
-    break;
-void interruptExecute(int opcode) {
-  switch (opcode) {
-    op(0xC7, RST(0x00 * 8));
-    op(0xD7, RST(0x02 * 8));
-    op(0xE7, RST(0x04 * 8));
-    op(0xF7, RST(0x06 * 8));
-    op(0xCF, RST(0x01 * 8));
-    op(0xDF, RST(0x03 * 8));
-    op(0xEF, RST(0x05 * 8));
-    op(0xFF, RST(0x07 * 8));
-  }
-}
-#undef op
+// Frames go out through the ring and the window reads them back from it,
+// like any other reader. SI_FRAME_RING=<name> shares it with other
+// processes.
+FrameRing frameRing;
+// SI_CAPTURE=<file.sicv> records the session in the background
+VideoCapture capture;
+// SI_PERF=<file or -> writes a JSON line of counters and stage times every
+// second. P, or SI_PERF_OVERLAY=1, shows the stage times on screen.
+PerfMonitor perf;
+bool perfOverlay = false;
+// Drops the conversion and presentation of frames when the host can't keep
+// up; emulation always runs. SI_FRAMESKIP=max=2,hold=30,... (frameskip.h)
+// sets the limits, SI_FRAMESKIP=off turns it off.
+FrameSkip frameSkip{FrameSkip::Config()};
 
 bool init() {
 #ifdef __APPLE__
@@ -81,16 +58,23 @@ bool init() {
 }
 
 void draw() {
+    FrameRing::View frame;
+    if (!frameRing.latest(&frame)) {
+        return;
+    }
     std::vector<int> indBits;
-    for (int i = 0x2400; i < 0x4000; ++i) {
-        indBits.push_back(i8080.memory.at(i) & 0b00000001);
-        indBits.push_back(i8080.memory.at(i) & 0b00000010);
-        indBits.push_back(i8080.memory.at(i) & 0b00000100);
-        indBits.push_back(i8080.memory.at(i) & 0b00001000);
-        indBits.push_back(i8080.memory.at(i) & 0b00010000);
-        indBits.push_back(i8080.memory.at(i) & 0b00100000);
-        indBits.push_back(i8080.memory.at(i) & 0b01000000);
-        indBits.push_back(i8080.memory.at(i) & 0b10000000);
+    for (size_t i = 0; i < frame.size; ++i) {
+        indBits.push_back(frame.data[i] & 0b00000001);
+        indBits.push_back(frame.data[i] & 0b00000010);
+        indBits.push_back(frame.data[i] & 0b00000100);
+        indBits.push_back(frame.data[i] & 0b00001000);
+        indBits.push_back(frame.data[i] & 0b00010000);
+        indBits.push_back(frame.data[i] & 0b00100000);
+        indBits.push_back(frame.data[i] & 0b01000000);
+        indBits.push_back(frame.data[i] & 0b10000000);
+    }
+    if (!frameRing.stillValid(frame)) {
+        return;
     }
     //std::cout << indBits.size() << std::endl;
     
@@ -101,6 +85,25 @@ void draw() {
     }
 }
 
+// A bar per stage across the top of the screen, as long as the stage's
+// mean time in the current window is a part of a frame (16.7 ms)
+void drawPerf() {
+    const double budgetNs = 1e9 / 60;
+    for (int s = 0; s < PerfMonitor::stageCount; ++s) {
+        const TimeHistogram &h = perf.window[s];
+        double mean = h.count != 0 ? h.meanNs() : perf.total[s].meanNs();
+        int length = static_cast<int>(std::min(1.0, mean / budgetNs) * 224);
+        // Screen row r is texel 255 - r of every column
+        int x = 255 - (1 + 2 * s);
+        for (int c = 0; c < 224; ++c) {
+            float lit = c < length ? 1.0f : 0.0f;
+            size_t i = (c * 256 + x) * 3;
+            display.pixels[i] = display.pixels[i + 1] =
+                display.pixels[i + 2] = lit;
+        }
+    }
+}
+
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     switch(action) {
         case(GLFW_PRESS): {
@@ -114,6 +117,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 case(GLFW_KEY_2):
                     i8080.Read0 |= 0b00000010;
                     break;
+                case(GLFW_KEY_P):
+                    perfOverlay = !perfOverlay;
+                    break;
                 case(GLFW_KEY_SPACE):
                     i8080.Read0 |= 0b00010000;
                     i8080.Read1 |= 0b00010000;
@@ -160,61 +166,106 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 
 int main2(void *window2, const char *zipFile) {
   // Initialize Program Counter & Stack Pointer
-  i8080.pc = 0x0;
-  i8080.sp = 0xf000;
+  machine.reset();
 
   // Extract ROM files from the selected ZIP file
   std::string zipF(zipFile);
   zipF.erase(0, 6); // Remove file://
-  int32_t err = ZIP_ER_OK;
-  zip *z = zip_open(zipF.c_str(), 0, &err);
-  if (err != ZIP_ER_OK) {
-    return err;
+  if (!machine.loadRomZip(zipF.c_str())) {
+    return 1;
   }
 
-  // Load ROMs
-  loadRomZip(z, "invaders.h", 0);
-  loadRomZip(z, "invaders.g", 0x800);
-  loadRomZip(z, "invaders.f", 0x1000);
-  loadRomZip(z, "invaders.e", 0x1800);
+  // Samples 0.wav-9.wav next to the ROM, if there are any
+  sound.loadSamples(zipF.substr(0, zipF.find_last_of('/')).c_str());
+  i8080.sound = &sound;
+  audioOut.start();
 
-  // Close ZIP file
-  zip_close(z);
+  if (!frameRing.create(getenv("SI_FRAME_RING"), FrameRing::Vram)) {
+    return 1;
+  }
+  if (const char *path = getenv("SI_CAPTURE")) {
+    capture.start(path);
+  }
+  if (const char *path = getenv("SI_PERF")) {
+    if (!perf.open(path)) {
+      std::cout << "cannot write " << path << std::endl;
+    }
+  }
+  if (const char *on = getenv("SI_PERF_OVERLAY")) {
+    perfOverlay = strcmp(on, "0") != 0;
+  }
+  if (const char *spec = getenv("SI_FRAMESKIP")) {
+    if (!frameSkip.config.parse(spec)) {
+      std::cout << "bad SI_FRAMESKIP " << spec << std::endl;
+      return 1;
+    }
+  }
+  perf.frameSkip = &frameSkip;
 
-  // Choose which interrupt to execute
-  bool interruptSwitch = false;
-  uint32_t refresh = (2000000 / 60) / 2; // Refresh rate
-    
     display.start();
     glfwSetKeyCallback(display.window, key_callback);
 
     while (!static_cast<bool>(glfwWindowShouldClose(display.window))) {
-        i8080.emulateCycle();
-        
-        if (i8080.interrupts && (i8080.cycles >= refresh)) {
+        PerfMonitor::Timer pass(perf, PerfMonitor::Loop);
+        bool present = frameSkip.beginPass();
+        {
+            PerfMonitor::Timer t(perf, PerfMonitor::Input);
             glfwPollEvents();
-            
-            if (interruptSwitch) {
-                interruptExecute(0xd7);
-            } else {
-                interruptExecute(0xcf);
+        }
+
+        // A whole frame, both interrupts, so every pass has a new picture
+        // to publish and show
+        {
+            PerfMonitor::Timer t(perf, PerfMonitor::Emulation);
+            machine.stepFrame();
+        }
+        frameRing.publish(machine);
+        if (capture.running()) {
+            capture.push(machine);
+        }
+
+        // Update pixels, unless this frame is dropped
+        if (present) {
+            {
+                PerfMonitor::Timer t(perf, PerfMonitor::Conversion);
+                draw();
+                if (perfOverlay) {
+                    drawPerf();
+                }
             }
-            
-            interruptSwitch = !interruptSwitch;
-            i8080.interrupts = false;
-            
-
-            
-            // Update pixels
-            draw();
+            PerfMonitor::Timer t(perf, PerfMonitor::Present);
             display.draw();
-
-            glfwPollEvents();
-            
-            i8080.cycles = 0;
+        } else {
+            // Nothing waits for vsync in this pass
+            frameSkip.pace();
         }
+        perf.tick(machine);
     }
-    
+
+  audioOut.stop();
+  if (perf.reporting()) {
+    perf.report(machine);
+    perf.close();
+  }
+  std::cout << "frameskip: " << frameSkip.skipped << " of "
+            << frameSkip.presented + frameSkip.skipped
+            << " frames not drawn (" << frameSkip.skipRatio() * 100
+            << "%), level " << frameSkip.level() << " at exit" << std::endl;
+  if (capture.running()) {
+    capture.stop();
+    std::cout << "capture: " << capture.frames << " frames, "
+              << capture.dropped << " dropped, " << capture.bytes
+              << " bytes" << std::endl;
+  }
+  Sound::Stats st = sound.stats();
+  std::cout << "audio: " << st.underruns << " underruns, " << st.dropped
+            << " samples dropped, latency " << st.latencyMs << " ms (max "
+            << st.maxLatencyMs << " ms)" << std::endl;
+  if (i8080.unimplemented != 0) {
+    std::cout << i8080.unimplemented << " unimplemented opcodes executed, last "
+              << std::hex << static_cast<int>(i8080.lastUnimplemented)
+              << std::dec << std::endl;
+  }
 
   return 0;
 }
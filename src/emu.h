@@ -1,24 +1,81 @@
 #ifndef emu_h
 #define emu_h
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
-struct intel8080 {
+struct IoPorts;
+struct Sound;
+struct intel8080;
+
+// IoPorts::invaders(), for intel8080::ports
+const IoPorts *defaultPorts();
+
+/* Receives what the debug core does: every instruction, the data reads
+ * and writes they make (not opcode and operand fetches) and IN/OUT. The
+ * profiler, the tracer and the debugger implement the parts they need.
+ */
+struct CpuHooks {
+  virtual ~CpuHooks() = default;
+  virtual void before(const intel8080 &) {}
+  virtual void after(const intel8080 &) {}
+  virtual void onRead(uint16_t, uint8_t) {}
+  virtual void onWrite(uint16_t, uint8_t) {}
+  virtual void onIn(uint8_t) {}
+  virtual void onOut(uint8_t, uint8_t) {}
+};
+
+/* Compile-time feature sets. emulateCycle and the handlers that touch memory
+ * are templates over one of these, and each set is a separate core: hooks
+ * a set leaves out are not compiled into it at all. Both are built; which
+ * one runs is chosen per instruction by whether intel8080::hooks is set.
+ */
+struct ProductionFeatures {
+  static constexpr bool hooks = false;
+};
+struct DebugFeatures {
+  static constexpr bool hooks = true;
+};
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the register pairs assume a little-endian host"
+#endif
+
+/* Everything an instruction changes apart from memory, kept together in
+ * the first bytes of intel8080 so it shares a cache line with the memory
+ * map, and can be saved or restored with one assignment. Each register
+ * pair can be used as its two bytes or as one 16-bit value (the low byte
+ * comes first in memory on a little-endian host).
+ */
+struct CpuState {
   uint16_t pc, sp;
   uint32_t cycles;
-  uint8_t A, B, C, D, E, H, L;
+  union {
+    struct {
+      uint8_t C, B;
+    };
+    uint16_t BC;
+  };
+  union {
+    struct {
+      uint8_t E, D;
+    };
+    uint16_t DE;
+  };
+  union {
+    struct {
+      uint8_t L, H;
+    };
+    uint16_t HL;
+  };
+  uint8_t A;
   bool interrupts;
-  std::array<uint8_t, 65536> memory;
-
-  // Access memory[HL]
-  uint8_t* memHL() {
-    return &memory.at((H << 8) | L);
-  }
 
   struct Flags {
     bool Z, S, P, CY, AC;
 
-    uint8_t psw() {
+    uint8_t psw() const {
       uint8_t res = 0b00000010;
       if (CY) {
         res |= 0b00000001;
@@ -47,6 +104,68 @@ struct intel8080 {
     }
   } f;
 
+  // A and the flags, as PUSH PSW stores them
+  uint16_t PSW() const { return (A << 8) | f.psw(); }
+};
+static_assert(sizeof(CpuState) <= 24, "CpuState grew");
+
+// The hot state and the memory map fit in the first cache line
+struct alignas(64) intel8080 : CpuState {
+  /* Memory map: the shared read-only ROM below romEnd and this instance's
+   * RAM above it. RAM repeats every ramMask + 1 bytes (the Space Invaders
+   * board mirrors its 8 KB above 0x4000). Writes to ROM are ignored.
+   */
+  const uint8_t *rom = nullptr;
+  uint16_t romEnd = 0x2000;
+  uint16_t ramMask = 0x1fff;
+  std::vector<uint8_t> ram = std::vector<uint8_t>(0x2000);
+
+  uint8_t read(uint16_t adr) const {
+    return adr < romEnd ? rom[adr] : ram[adr & ramMask];
+  }
+
+  void write(uint16_t adr, uint8_t val) {
+    if (adr >= romEnd) {
+      size_t i = adr & ramMask;
+      ram[i] = val;
+      markDirty(i);
+    }
+  }
+
+  /* RAM pages written since the bits were last cleared, one bit per 256
+   * bytes. Restoring a snapshot then only has to copy those pages back
+   * (MachineState::restore). Anything that writes to ram other than
+   * through write() marks what it changed.
+   */
+  static constexpr size_t pageSize = 256;
+  std::array<uint64_t, 4> dirty = {};
+
+  void markDirty(size_t i) {
+    size_t page = i / pageSize;
+    dirty[page / 64] |= 1ULL << (page % 64);
+  }
+  // n bytes from RAM index i
+  void markDirty(size_t i, size_t n) {
+    if (n == 0) {
+      return;
+    }
+    for (size_t page = i / pageSize; page <= (i + n - 1) / pageSize; ++page) {
+      dirty[page / 64] |= 1ULL << (page % 64);
+    }
+  }
+  void markAllDirty() { dirty.fill(~0ULL); }
+  void clearDirty() { dirty = {}; }
+
+  // Flat 64 KB of RAM and no ROM
+  void mapFlat() {
+    rom = nullptr;
+    romEnd = 0;
+    ramMask = 0xffff;
+    ram.assign(0x10000, 0);
+    markAllDirty();
+  }
+
+
   /* Interrupts: $cf (RST 0x08) at the start of vblank
    * $d7 (RST 0x10) at the end of vblank.
    */
@@ -55,35 +174,88 @@ struct intel8080 {
   uint8_t Read0 = 0x00;
   uint8_t Read1 = 0b10000011;
 
-  // Hardware shifter
-  uint16_t noOfBitsToShift = 0x00;
-  uint32_t shift0 = 0;
-  uint32_t shift1 = 0;
+  // Hardware shifter (io.h): the last two bytes written, newest on top,
+  // and the 8 bits starting amount bits below the top
+  struct Shifter {
+    uint16_t value = 0;
+    uint8_t amount = 0;
+    uint8_t result = 0;
+
+    void update() { result = (value >> (8 - amount)) & 0xff; }
+  } shifter;
+
+  // The I/O bus, shared like rom. IoPorts::invaders() unless set.
+  const IoPorts *ports = defaultPorts();
+
+  // Receives the sound port writes (3 and 5) when set
+  Sound *sound = nullptr;
+
+  // Runs the debug core when set
+  CpuHooks *hooks = nullptr;
+
+  // Data accesses of instructions, seen by the hooks in the debug core
+  template <typename F> uint8_t load(uint16_t adr) {
+    uint8_t val = read(adr);
+    if constexpr (F::hooks) {
+      hooks->onRead(adr, val);
+    }
+    return val;
+  }
+
+  template <typename F> void store(uint16_t adr, uint8_t val) {
+    if constexpr (F::hooks) {
+      hooks->onWrite(adr, val);
+    }
+    write(adr, val);
+  }
+
+  // Opcodes executed that aren't implemented. They take 4 cycles and
+  // leave pc where it is.
+  uint64_t unimplemented = 0;
+  uint8_t lastUnimplemented = 0;
+
+  // One instruction on the core matching hooks
+  void emulateCycle() {
+    if (hooks != nullptr) {
+      step<DebugFeatures>();
+    } else {
+      step<ProductionFeatures>();
+    }
+  }
+
+  // Push pc and jump to vector, as the interrupt controller does
+  void interrupt(uint8_t vector) {
+    if (hooks != nullptr) {
+      RST<DebugFeatures>(vector);
+    } else {
+      RST<ProductionFeatures>(vector);
+    }
+  }
 
-  // dispatcher.cpp
-  void emulateCycle();
+  // dispatcher.cpp, instantiated for both feature sets
+  template <typename F> void step();
+  // The instruction at pc, whose opcode is given
+  template <typename F> void execute(uint8_t opcode);
+  // The instructions of a fusion rule back to back (fusion.h)
+  template <uint8_t... Ops> void fused();
 
-  // cpu.cpp
+  // cpu.cpp. The templates are instantiated there for both feature sets.
   bool parity(uint8_t b);
   bool zero(uint8_t b);
   bool sign(uint8_t b);
   bool carry(uint32_t b);
 
   auto NOP() -> void;
-  void LXI(uint8_t *reg1, uint8_t *reg2);
   void LXI(uint16_t *reg);
   void DCR(uint8_t *reg, uint8_t opCycles);
-  void STAX(const uint8_t *reg1, const uint8_t *reg2);
+  template <typename F> void STAX(uint16_t adr);
   void INX(uint16_t *reg);
-  void INX(uint8_t *reg1, uint8_t *reg2);
   void MOV(uint8_t *reg1, const uint8_t *reg2, uint8_t opCycles);
   void INR(uint8_t *reg, uint8_t opCycles);
   void DCX(uint16_t *reg);
-  void DCX(uint8_t *reg1, uint8_t *reg2);
   void MVI(uint8_t *reg, uint8_t opCycles);
-  void DAD(const uint8_t *reg1, const uint8_t *reg2);
   void DAD(const uint16_t *reg);
-  void LDAX(const uint8_t *reg1, const uint8_t *reg2);
+  template <typename F> void LDAX(uint16_t adr);
   void ADD(const uint8_t *reg, uint8_t opCycles);
   void ADC(const uint8_t *reg, uint8_t opCycles);
   void SUB(const uint8_t *reg, uint8_t opCycles);
@@ -93,29 +265,28 @@ struct intel8080 {
   void ORA(const uint8_t *reg, uint8_t opCycles);
   void CMP(const uint8_t *reg, uint8_t opCycles);
 
-  void ret(bool condition);
-  void RST(const uint8_t num);
-  void call(bool condition);
+  template <typename F> void ret(bool condition);
+  template <typename F> void RST(const uint8_t num);
+  template <typename F> void call(bool condition);
   void enableDisableCY(bool operation);
   void enableDisableInterrupts(bool operation);
   void jump(bool condition);
-  void exchange(uint8_t *a1, uint8_t *a2, uint8_t *b1, uint8_t *b2,
-                uint8_t opCycles);
-  void storeLoadHL(bool storing);
+  void exchange(uint16_t *a, uint16_t *b, uint8_t opCycles);
+  template <typename F> void storeLoadHL(bool storing);
   void putHL(uint16_t *r);
 
-  template <typename T> void PUSH(const uint8_t *reg1, T reg2) {
-    memory.at(sp - 1) = *reg1;
-    memory.at(sp - 2) = reg2;
+  template <typename F, typename T> void PUSH(const uint8_t *reg1, T reg2) {
+    store<F>(sp - 1, *reg1);
+    store<F>(sp - 2, reg2);
     sp = sp - 2;
 
     pc += 1;
     cycles += 11;
   }
 
-  template <typename T> void POP(uint8_t *reg1, T *reg2) {
-    *reg1 = memory.at(sp + 1);
-    *reg2 = memory.at(sp);
+  template <typename F, typename T> void POP(uint8_t *reg1, T *reg2) {
+    *reg1 = load<F>(sp + 1);
+    *reg2 = load<F>(sp);
     sp += 2;
 
     pc += 1;
@@ -0,0 +1,185 @@
+#include "./frame_ring.h"
+#include "./observe.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+
+namespace {
+constexpr char magic[4] = {'S', 'I', 'F', 'R'};
+constexpr uint16_t version = 1;
+constexpr size_t vramBytes = 0x4000 - 0x2400;
+
+constexpr size_t roundUp(size_t n) { return (n + 63) & ~size_t(63); }
+constexpr size_t headerBytes = roundUp(sizeof(FrameRing::Header));
+
+size_t frameBytesOf(FrameRing::Format format) {
+  return format == FrameRing::Unpacked ? observe::size(1) : vramBytes;
+}
+} // namespace
+
+bool FrameRing::create(const char *name, Format format, uint16_t slots) {
+  close();
+  if (slots == 0 || (format != Vram && format != Unpacked)) {
+    return false;
+  }
+  const size_t frameBytes = frameBytesOf(format);
+  const size_t slotBytes = roundUp(sizeof(Slot) + frameBytes);
+  const size_t total = headerBytes + slots * slotBytes;
+
+  void *p = MAP_FAILED;
+  if (name == nullptr) {
+    p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON,
+             -1, 0);
+  } else {
+    // A ring left by a writer that didn't close it is replaced
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    if (ftruncate(fd, total) == 0) {
+      p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(name);
+      return false;
+    }
+    this->name = name;
+  }
+  if (p == MAP_FAILED) {
+    return false;
+  }
+
+  header = new (p) Header();
+  header->version = version;
+  header->slots = slots;
+  header->format = format;
+  header->frameBytes = static_cast<uint32_t>(frameBytes);
+  header->slotBytes = static_cast<uint32_t>(slotBytes);
+  header->published.store(0, std::memory_order_relaxed);
+  for (uint16_t i = 0; i < slots; ++i) {
+    new (slot(i)) Slot();
+    slot(i)->seq.store(0, std::memory_order_relaxed);
+  }
+  // Readers only look at a ring once the magic is there
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header->magic, magic, sizeof(magic));
+
+  mappedBytes = total;
+  owner = true;
+  return true;
+}
+
+bool FrameRing::open(const char *name) {
+  close();
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= headerBytes) {
+    p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+
+  auto *h = static_cast<Header *>(p);
+  size_t total = headerBytes + size_t(h->slots) * h->slotBytes;
+  bool ok = memcmp(h->magic, magic, sizeof(magic)) == 0 &&
+            h->version == version && h->slots > 0 &&
+            (h->format == Vram || h->format == Unpacked) &&
+            h->frameBytes == frameBytesOf(static_cast<Format>(h->format)) &&
+            h->slotBytes >= roundUp(sizeof(Slot) + h->frameBytes) &&
+            total <= static_cast<size_t>(st.st_size);
+  if (!ok) {
+    munmap(p, st.st_size);
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  header = h;
+  mappedBytes = st.st_size;
+  return true;
+}
+
+void FrameRing::close() {
+  if (header == nullptr) {
+    return;
+  }
+  munmap(header, mappedBytes);
+  if (owner && !name.empty()) {
+    shm_unlink(name.c_str());
+  }
+  header = nullptr;
+  mappedBytes = 0;
+  name.clear();
+  owner = false;
+}
+
+FrameRing::Slot *FrameRing::slot(uint64_t n) const {
+  char *base = reinterpret_cast<char *>(header) + headerBytes;
+  return reinterpret_cast<Slot *>(base + (n % header->slots) *
+                                             header->slotBytes);
+}
+
+void FrameRing::publish(const Machine &m) {
+  const uint64_t n = header->published.load(std::memory_order_relaxed);
+  Slot *s = slot(n);
+  s->seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  s->info.frame = m.frames;
+  s->info.totalCycles = m.totalCycles;
+  s->info.pc = m.cpu.pc;
+  s->info.sp = m.cpu.sp;
+  s->info.read0 = m.cpu.Read0;
+  s->info.read1 = m.cpu.Read1;
+  s->info.interrupts = m.cpu.interrupts;
+  auto *data = reinterpret_cast<uint8_t *>(s + 1);
+  if (header->format == Unpacked) {
+    observe::unpack(m.vram(), 1, data);
+  } else {
+    memcpy(data, m.vram(), vramBytes);
+  }
+
+  s->seq.store(2 * n + 2, std::memory_order_release);
+  header->published.store(n + 1, std::memory_order_release);
+}
+
+bool FrameRing::read(uint64_t n, View *v) const {
+  uint64_t published = this->published();
+  if (n >= published || published - n > header->slots) {
+    return false;
+  }
+  const Slot *s = slot(n);
+  uint64_t seq = s->seq.load(std::memory_order_acquire);
+  if (seq != 2 * n + 2) {
+    return false;
+  }
+  v->number = n;
+  v->info = s->info;
+  v->data = reinterpret_cast<const uint8_t *>(s + 1);
+  v->size = header->frameBytes;
+  v->seq = seq;
+  v->slot = s;
+  // The copy of info counts as a use
+  return stillValid(*v);
+}
+
+bool FrameRing::latest(View *v) const {
+  uint64_t published = this->published();
+  return published > 0 && read(published - 1, v);
+}
+
+bool FrameRing::stillValid(const View &v) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return v.slot->seq.load(std::memory_order_relaxed) == v.seq;
+}
@@ -0,0 +1,104 @@
+#ifndef frame_ring_h
+#define frame_ring_h
+#include "./machine.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Finished frames published to a ring of slots in shared memory, for
+ * readers in other processes (recorders, inference, dashboards) and for
+ * the frontend. The writer never waits: every slot has a sequence number
+ * that is odd while the slot is being written (a seqlock), and a reader
+ * that finds it odd or changed after reading knows the frame was
+ * overwritten under it and drops it. Readers get pointers straight into
+ * the mapping; nothing is copied or sent.
+ *
+ * Layout (native endian, the ring never leaves the machine):
+ *   Header | slots * { Slot | frame bytes }
+ * Every slot starts on a 64-byte boundary.
+ */
+struct FrameRing {
+  enum Format : uint32_t {
+    Vram = 1,     // the 7168 bytes of 1bpp video RAM as the CPU sees them
+    Unpacked = 2, // observe::unpack at full size: one byte per pixel
+  };
+
+  struct Header {
+    char magic[4]; // "SIFR"
+    uint16_t version;
+    uint16_t slots;
+    uint32_t format;
+    uint32_t frameBytes;
+    uint32_t slotBytes;
+    std::atomic<uint64_t> published; // frames published so far
+  };
+
+  // The machine when the frame was finished
+  struct Info {
+    uint64_t frame = 0;
+    uint64_t totalCycles = 0;
+    uint16_t pc = 0, sp = 0;
+    uint8_t read0 = 0, read1 = 0;
+    bool interrupts = false;
+  };
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> seq; // 2n + 2 once frame n is complete
+    Info info;
+  };
+
+  // A frame being read. Only valid while stillValid() says so.
+  struct View {
+    uint64_t number = 0; // publication count, 0 for the first frame
+    Info info;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint64_t seq = 0;
+    const Slot *slot = nullptr;
+  };
+
+  FrameRing() = default;
+  FrameRing(const FrameRing &) = delete;
+  FrameRing &operator=(const FrameRing &) = delete;
+  ~FrameRing() { close(); }
+
+  // Create the ring as POSIX shared memory named name (e.g. "/si-frames"),
+  // replacing one left behind, or private to this process when name is
+  // null
+  bool create(const char *name, Format format, uint16_t slots = 8);
+  // Map a ring another process created, read only
+  bool open(const char *name);
+  // Unmap it; the creator also unlinks the name
+  void close();
+
+  bool isOpen() const { return header != nullptr; }
+  Format format() const { return static_cast<Format>(header->format); }
+  size_t frameBytes() const { return header->frameBytes; }
+  uint64_t published() const {
+    return header->published.load(std::memory_order_acquire);
+  }
+
+  // Writer: copy m's video RAM into the next slot
+  void publish(const Machine &m);
+
+  // Reader: the newest frame, or frame number n if it is still in the ring.
+  // False when there is none yet, it was overwritten or it is being
+  // written.
+  bool latest(View *v) const;
+  bool read(uint64_t n, View *v) const;
+  // True if nothing overwrote v's frame since it was read: check it after
+  // using v.data
+  bool stillValid(const View &v) const;
+
+private:
+  Header *header = nullptr;
+  size_t mappedBytes = 0;
+  std::string name;
+  bool owner = false;
+
+  Slot *slot(uint64_t n) const;
+};
+
+#endif /* frame_ring_h */
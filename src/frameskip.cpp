@@ -0,0 +1,113 @@
+#include "./frameskip.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+void average(double &mean, double sample, double weight) {
+  mean = mean == 0 ? sample : mean + (sample - mean) * weight;
+}
+} // namespace
+
+bool FrameSkip::Config::parse(const char *spec) {
+  if (!strcmp(spec, "off") || !strcmp(spec, "0")) {
+    maxSkip = 0;
+    return true;
+  }
+  std::string s(spec);
+  size_t at = 0;
+  while (at < s.size()) {
+    size_t end = s.find(',', at);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    std::string item = s.substr(at, end - at);
+    at = end + 1;
+
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) {
+      return false;
+    }
+    std::string key = item.substr(0, eq);
+    const char *value = item.c_str() + eq + 1;
+    char *rest = nullptr;
+    double v = strtod(value, &rest);
+    if (rest == value || *rest != '\0' || v < 0) {
+      return false;
+    }
+    if (key == "max") {
+      maxSkip = static_cast<int>(v);
+    } else if (key == "budget" && v > 0) {
+      budgetMs = v;
+    } else if (key == "high") {
+      high = v;
+    } else if (key == "low") {
+      low = v;
+    } else if (key == "hold") {
+      hold = static_cast<int>(v);
+    } else {
+      return false;
+    }
+  }
+  return low <= high;
+}
+
+FrameSkip::FrameSkip(const Config &config) : config(config) {}
+
+double FrameSkip::predict(int level) const {
+  // Nothing skipped yet: every pass so far presented
+  if (skippedMean == 0) {
+    return presentedMean;
+  }
+  return skippedMean + (presentedMean - skippedMean) / (level + 1);
+}
+
+bool FrameSkip::beginPass() {
+  auto now = Clock::now();
+  auto slot = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>(config.budgetMs));
+  due = started ? std::max(due + slot, now - slot * config.maxSkip)
+                : now + slot;
+  if (started) {
+    double ns = std::chrono::duration<double, std::nano>(now - last).count();
+    average(mean, ns, config.smoothing);
+    average(lastPresented ? presentedMean : skippedMean, ns,
+            config.smoothing);
+
+    const double budget = config.budgetMs * 1e6;
+    bool slow = skipLevel < config.maxSkip &&
+                predict(skipLevel) > config.high * budget;
+    bool fast = skipLevel > 0 && predict(skipLevel - 1) < config.low * budget;
+    over = slow ? over + 1 : 0;
+    under = fast ? under + 1 : 0;
+    if (over >= config.hold) {
+      // Straight to the first level predicted to fit, once skipped passes
+      // have been measured
+      int next = skipLevel + 1;
+      while (skippedMean != 0 && next < config.maxSkip &&
+             predict(next) > config.high * budget) {
+        next++;
+      }
+      skipLevel = next;
+    } else if (under >= config.hold) {
+      skipLevel--;
+    }
+    if (over >= config.hold || under >= config.hold) {
+      over = under = 0;
+      phase = 0;
+    }
+  }
+  last = now;
+  started = true;
+
+  bool present = phase % (skipLevel + 1) == 0;
+  phase++;
+  lastPresented = present;
+  (present ? presented : skipped)++;
+  return present;
+}
+
+void FrameSkip::pace() { std::this_thread::sleep_until(due); }
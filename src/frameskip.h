@@ -0,0 +1,82 @@
+#ifndef frameskip_h
+#define frameskip_h
+
+#include <chrono>
+#include <cstdint>
+
+/* Adaptive frameskip for the frontend loop. Every pass of the loop
+ * emulates a frame; the controller decides which passes also convert
+ * and present the screen. Emulation is never skipped, so emulated time
+ * stays exact and only pictures are dropped.
+ *
+ * Skip level k presents one pass in k + 1. The controller measures the
+ * time between passes and keeps a moving average of presented and skipped
+ * passes apart, which predicts the mean pass time at any level:
+ * skipped + (presented - skipped) / (k + 1). It goes up a level once the
+ * mean has been above high * budget for hold passes in a row, and down
+ * once the level below is predicted to stay under low * budget for as
+ * long; the gap between high and low and the hold keep it from flapping.
+ *
+ * Only presented passes wait for vsync, so a skipped pass ends with
+ * pace(), which sleeps until its slot in real time is over: pass k ends
+ * budget * k after the first, and the skipped passes make up for the
+ * presented ones that ran over. Emulated time then keeps to real time.
+ * The pass times measured include that wait. Lateness of more than
+ * maxSkip passes is dropped rather than caught up.
+ */
+struct FrameSkip {
+  struct Config {
+    // A frame of real time
+    double budgetMs = 1000.0 / 60;
+    // Passes skipped in a row at most: 2 still presents 20 times a second
+    int maxSkip = 2;
+    double high = 1.05;
+    double low = 0.85;
+    int hold = 30;
+    // Weight of a new pass in the moving averages
+    double smoothing = 1.0 / 16;
+
+    // "max=2,budget=16.7,high=1.05,low=0.85,hold=30", any subset. "off"
+    // or "0" is max=0. False on an unknown key or a bad value.
+    bool parse(const char *spec);
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  explicit FrameSkip(const Config &config);
+
+  // At the start of every pass: whether this one presents. The time since
+  // the last call is the previous pass's.
+  bool beginPass();
+  // At the end of a pass that didn't present: sleeps until its slot ends
+  void pace();
+
+  int level() const { return skipLevel; }
+  // Mean pass time now, in ms
+  double meanMs() const { return mean / 1e6; }
+  uint64_t presented = 0;
+  uint64_t skipped = 0;
+  // Skipped passes over all of them
+  double skipRatio() const {
+    uint64_t all = presented + skipped;
+    return all != 0 ? double(skipped) / all : 0;
+  }
+
+  Config config;
+
+private:
+  Clock::time_point last;
+  // When the current pass's slot ends
+  Clock::time_point due;
+  bool started = false;
+  bool lastPresented = true;
+  int skipLevel = 0;
+  uint64_t phase = 0;
+  // Moving averages of pass times in ns: all passes, presented, skipped
+  double mean = 0, presentedMean = 0, skippedMean = 0;
+  int over = 0, under = 0;
+
+  double predict(int level) const;
+};
+
+#endif /* frameskip_h */
@@ -0,0 +1,62 @@
+#include "./fusion.h"
+#include "./disasm.h"
+
+#include <algorithm>
+
+namespace {
+// EI takes effect after the next instruction, and the interrupt check
+// between the two would be skipped
+bool fusable(const std::vector<uint8_t> &ops) {
+  return std::find(ops.begin(), ops.end(), 0xfb) == ops.end();
+}
+
+// Whether the instructions at adr have the opcodes of ops
+bool matches(const RomImage &image, size_t adr,
+             const std::vector<uint8_t> &ops) {
+  for (uint8_t op : ops) {
+    if (adr >= RomImage::size || image.data()[adr] != op) {
+      return false;
+    }
+    adr += disasm::opcode(op).length;
+  }
+  // Operands of the last one included
+  return adr <= RomImage::size;
+}
+} // namespace
+
+const std::vector<FusionRule> &fusionRules() {
+  static const std::vector<FusionRule> rules = [] {
+    std::vector<FusionRule> rules;
+#define FUSION_RULE(name, ...)                                                 \
+  rules.push_back({#name, static_cast<uint8_t>(rules.size()), {__VA_ARGS__},   \
+                   fusedHandlers[rules.size()], 0});
+#include "./fusion_rules.h"
+#undef FUSION_RULE
+    for (FusionRule &r : rules) {
+      r.maxCycles = 18 * r.ops.size();
+    }
+    return rules;
+  }();
+  return rules;
+}
+
+std::shared_ptr<const Fusion> Fusion::forRom(const RomImage &image,
+                                             const std::vector<std::string> &off) {
+  auto fusion = std::make_shared<Fusion>();
+  fusion->romHash = image.hash();
+  for (const FusionRule &r : fusionRules()) {
+    fusion->rules[r.index] = &r;
+  }
+  for (size_t adr = 0; adr < RomImage::size; ++adr) {
+    // The first rule that matches
+    for (const FusionRule &r : fusionRules()) {
+      bool disabled = std::find(off.begin(), off.end(), r.name) != off.end();
+      if (!disabled && fusable(r.ops) && matches(image, adr, r.ops)) {
+        fusion->byAddress[adr] = r.index + 1;
+        fusion->sites[r.index]++;
+        break;
+      }
+    }
+  }
+  return fusion;
+}
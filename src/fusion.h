@@ -0,0 +1,69 @@
+#ifndef fusion_h
+#define fusion_h
+#include "./emu.h"
+#include "./rom.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Superinstructions: short opcode sequences from fusion_rules.h that run as
+ * one call. Each rule becomes intel8080::fused<ops...>, where the switch of
+ * every instruction folds down to its one case, so there is one dispatch
+ * for the whole sequence instead of one per instruction. The state after a
+ * fused sequence is exactly the state after stepping through it.
+ */
+using FusedHandler = void (intel8080::*)();
+
+// dispatcher.cpp, in the order of fusion_rules.h
+extern const FusedHandler fusedHandlers[];
+
+constexpr size_t fusionRuleCount = 0
+#define FUSION_RULE(name, ...) +1
+#include "./fusion_rules.h"
+#undef FUSION_RULE
+    ;
+static_assert(fusionRuleCount < 256, "rule indexes are bytes");
+
+struct FusionRule {
+  const char *name;
+  uint8_t index; // into fusedHandlers and Machine::fusionHits
+  std::vector<uint8_t> ops;
+  FusedHandler run;
+  // No instruction takes more than 18 cycles (XTHL), so a sequence that
+  // starts this far before a check can't cross it
+  uint32_t maxCycles;
+};
+
+// The rules of fusion_rules.h
+const std::vector<FusionRule> &fusionRules();
+
+/* Where the rules apply in one ROM image: every address at which a rule's
+ * opcodes follow one another, skipping their operands. Shared by every
+ * Machine running that image, like the image itself.
+ */
+struct Fusion {
+  // Rules found in the image, except the ones named in off
+  static std::shared_ptr<const Fusion> forRom(
+      const RomImage &image, const std::vector<std::string> &off = {});
+
+  uint64_t romHash = 0;
+  // Addresses each rule was found at, by rule index
+  std::vector<uint32_t> sites = std::vector<uint32_t>(fusionRuleCount);
+
+  const FusionRule *at(uint16_t pc) const {
+    uint8_t i = pc < RomImage::size ? byAddress[pc] : 0;
+    return i == 0 ? nullptr : rules[i - 1];
+  }
+
+private:
+  // Checked before every instruction, so kept small enough to stay in L1:
+  // a rule index + 1 per address, 0 for none. Inline rather than a vector,
+  // so a hoisted Fusion pointer is all the lookup needs.
+  std::array<uint8_t, RomImage::size> byAddress{};
+  std::array<const FusionRule *, fusionRuleCount> rules{};
+};
+
+#endif /* fusion_h */
@@ -0,0 +1,27 @@
+// Fusion rules, one per line: FUSION_RULE(name, opcodes...). Only the last
+// instruction may jump, call or return, and none may be EI. Where two rules
+// start with the same instructions the earlier one wins.
+//
+// Included by fusion.cpp and dispatcher.cpp with their own FUSION_RULE, so
+// there is no include guard.
+
+// LDAX D; MOV M,A; INX H; INX D; DCR B; JNZ
+FUSION_RULE(CopyLoop, 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2)
+// MOV A,M; ORA A; JZ / JNZ
+FUSION_RULE(TestMJz, 0x7e, 0xb7, 0xca)
+FUSION_RULE(TestMJnz, 0x7e, 0xb7, 0xc2)
+// DCR B / DCR C; JNZ
+FUSION_RULE(DcrBJnz, 0x05, 0xc2)
+FUSION_RULE(DcrCJnz, 0x0d, 0xc2)
+// Saving registers around calls
+FUSION_RULE(PushHPushD, 0xe5, 0xd5)
+FUSION_RULE(PushDPushH, 0xd5, 0xe5)
+FUSION_RULE(PushBCall, 0xc5, 0xcd)
+FUSION_RULE(PushDCall, 0xd5, 0xcd)
+FUSION_RULE(PushHCall, 0xe5, 0xcd)
+FUSION_RULE(PopDPopH, 0xd1, 0xe1)
+FUSION_RULE(PopHPopD, 0xe1, 0xd1)
+FUSION_RULE(PopBRet, 0xc1, 0xc9)
+FUSION_RULE(PopDRet, 0xd1, 0xc9)
+FUSION_RULE(PopHRet, 0xe1, 0xc9)
+FUSION_RULE(PopPswRet, 0xf1, 0xc9)
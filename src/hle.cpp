@@ -0,0 +1,287 @@
+#include "./hle.h"
+#include "./io.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Whole iterations of perIteration cycles that end by limit
+uint32_t budget(const intel8080 &cpu, uint32_t limit, uint32_t perIteration) {
+  return cpu.cycles < limit ? (limit - cpu.cycles) / perIteration : 0;
+}
+
+// The RAM behind adr..adr+n-1 when it is one run of bytes (no ROM, no
+// mirror wrap), else nullptr
+uint8_t *ramSpan(intel8080 &cpu, uint16_t adr, uint32_t n) {
+  size_t i = adr & cpu.ramMask;
+  if (adr < cpu.romEnd || adr + n > 0x10000 || i + n > cpu.ramMask + 1u) {
+    return nullptr;
+  }
+  return cpu.ram.data() + i;
+}
+
+const uint8_t *readSpan(intel8080 &cpu, uint16_t adr, uint32_t n) {
+  if (adr + n <= cpu.romEnd) {
+    return cpu.rom + adr;
+  }
+  return ramSpan(cpu, adr, n);
+}
+
+bool overlap(const uint8_t *a, const uint8_t *b, uint32_t n) {
+  auto x = reinterpret_cast<uintptr_t>(a), y = reinterpret_cast<uintptr_t>(b);
+  return x < y + n && y < x + n;
+}
+
+/* 1a32  LDAX D       copy B bytes from (DE) to (HL)
+ * 1a33  MOV M,A
+ * 1a34  INX H
+ * 1a35  INX D
+ * 1a36  DCR B
+ * 1a37  JNZ $1a32
+ */
+uint32_t blockCopy(intel8080 &cpu, uint32_t limit) {
+  const uint16_t entry = 0x1a32, exit = 0x1a3a;
+  const uint32_t perIteration = 7 + 7 + 5 + 5 + 5 + 10;
+
+  uint32_t left = cpu.B == 0 ? 256 : cpu.B;
+  uint32_t n = std::min(left, budget(cpu, limit, perIteration));
+  if (n == 0) {
+    return 0;
+  }
+
+  uint16_t de = cpu.DE, hl = cpu.HL;
+  const uint8_t *from = readSpan(cpu, de, n);
+  uint8_t *to = ramSpan(cpu, hl, n);
+  if (from != nullptr && to != nullptr && !overlap(from, to, n)) {
+    memcpy(to, from, n);
+    cpu.markDirty(to - cpu.ram.data(), n);
+    cpu.A = from[n - 1];
+  } else {
+    // Byte by byte, as the loop does it
+    for (uint32_t i = 0; i < n; ++i) {
+      cpu.A = cpu.read(de + i);
+      cpu.write(hl + i, cpu.A);
+    }
+  }
+
+  de += n;
+  hl += n;
+  cpu.DE = de;
+  cpu.HL = hl;
+  cpu.B -= n;
+  // From the last DCR B
+  cpu.f.Z = cpu.zero(cpu.B);
+  cpu.f.S = cpu.sign(cpu.B);
+  cpu.f.P = cpu.parity(cpu.B);
+
+  cpu.pc = n == left ? exit : entry;
+  cpu.cycles += n * perIteration;
+  return n;
+}
+
+/* 1a5f  MVI M,$00    zero from HL up to 0x3fff
+ * 1a61  INX H
+ * 1a62  MOV A,H
+ * 1a63  CPI $40
+ * 1a65  JNZ $1a5f
+ */
+uint32_t clearScreen(intel8080 &cpu, uint32_t limit) {
+  const uint16_t entry = 0x1a5f, exit = 0x1a68;
+  const uint32_t perIteration = 10 + 5 + 5 + 7 + 10;
+
+  uint16_t hl = cpu.HL;
+  // Until INX H brings H to 0x40
+  uint16_t next = hl + 1;
+  uint32_t left = (next >> 8) == 0x40 ? 1 : ((0x4000 - next) & 0xffff) + 1;
+  uint32_t n = std::min(left, budget(cpu, limit, perIteration));
+  if (n == 0) {
+    return 0;
+  }
+
+  uint8_t *to = ramSpan(cpu, hl, n);
+  if (to != nullptr) {
+    memset(to, 0, n);
+    cpu.markDirty(to - cpu.ram.data(), n);
+  } else {
+    for (uint32_t i = 0; i < n; ++i) {
+      cpu.write(hl + i, 0);
+    }
+  }
+
+  cpu.HL = hl + n;
+  cpu.A = cpu.H;
+  // From the last CPI $40
+  uint8_t res = cpu.A - 0x40;
+  cpu.f.CY = cpu.A < 0x40;
+  cpu.f.Z = cpu.zero(res);
+  cpu.f.S = cpu.sign(res);
+  cpu.f.P = cpu.parity(res);
+
+  cpu.pc = n == left ? exit : entry;
+  cpu.cycles += n * perIteration;
+  return n;
+}
+
+/* 1404  PUSH B       OR B rows of the sprite at (DE) onto the screen at
+ * 1405  PUSH H       (HL), through the shifter: each row is two bytes, the
+ * 1406  LDAX D       sprite byte moved along by the shift amount, and
+ * 1407  OUT 4        rows are 32 bytes apart
+ * 1409  IN 3
+ * 140b  ORA M
+ * 140c  MOV M,A
+ * 140d  INX H
+ * 140e  INX D
+ * 140f  XRA A
+ * 1410  OUT 4
+ * 1412  IN 3
+ * 1414  ORA M
+ * 1415  MOV M,A
+ * 1416  POP H
+ * 1417  LXI B,$0020
+ * 141a  DAD B
+ * 141b  POP B
+ * 141c  DCR B
+ * 141d  JNZ $1404
+ *
+ * The erase loop at 1427 is the same with a CMA before each ORA turned
+ * ANA, which clears the sprite's pixels instead.
+ */
+template <bool Erase> uint32_t shiftedSprite(intel8080 &cpu, uint32_t limit) {
+  const uint16_t entry = Erase ? 0x1427 : 0x1404;
+  const uint16_t exit = Erase ? 0x1445 : 0x1420;
+  const uint32_t perIteration = Erase ? 174 : 166;
+
+  // Only the board's shifter is done natively
+  const IoPorts &board = IoPorts::silent();
+  if (cpu.ports->out[4] != board.out[4] || cpu.ports->in[3] != board.in[3]) {
+    return 0;
+  }
+  uint32_t left = cpu.B == 0 ? 256 : cpu.B;
+  uint32_t n = std::min(left, budget(cpu, limit, perIteration));
+  if (n == 0) {
+    return 0;
+  }
+
+  const uint8_t amount = cpu.shifter.amount;
+  // The byte the first OUT 4 pushes down; the XRA A one leaves 0 after it
+  uint8_t below = cpu.shifter.value >> 8;
+  auto draw = [](uint8_t pixels, uint8_t screen) -> uint8_t {
+    return Erase ? ~pixels & screen : pixels | screen;
+  };
+
+  uint16_t de = cpu.DE, hl = cpu.HL, sp = cpu.sp;
+  uint8_t b = cpu.B, a = cpu.A, sprite = 0;
+  const uint8_t *from = readSpan(cpu, de, n);
+  uint8_t *to = ramSpan(cpu, hl, 32 * (n - 1) + 2);
+  uint8_t *stack = sp >= 4 ? ramSpan(cpu, sp - 4, 4) : nullptr;
+  if (from != nullptr && to != nullptr && stack != nullptr &&
+      !overlap(from, to, 32 * (n - 1) + 2) && !overlap(from, stack, 4) &&
+      !overlap(to, stack, 32 * (n - 1) + 2)) {
+    for (uint32_t i = 0; i < n; ++i) {
+      // Both bytes of the shifter's output for the row at once
+      sprite = from[i];
+      uint16_t pixels = (sprite << amount) | ((below << amount) >> 8);
+      below = 0;
+      to[32 * i] = draw(pixels & 0xff, to[32 * i]);
+      to[32 * i + 1] = a = draw(pixels >> 8, to[32 * i + 1]);
+    }
+    cpu.markDirty(to - cpu.ram.data(), 32 * (n - 1) + 2);
+    // What the last iteration pushed
+    uint16_t last = hl + 32 * (n - 1);
+    stack[3] = b - (n - 1);
+    stack[2] = cpu.C;
+    stack[1] = last >> 8;
+    stack[0] = last & 0xff;
+    cpu.markDirty(stack - cpu.ram.data(), 4);
+    de += n;
+    hl += 32 * n;
+    b -= n;
+  } else {
+    // Access by access, as the loop does them. Screen writes can reach
+    // the stack, so the count popped back decides when it ends.
+    uint32_t done = 0;
+    while (done < n) {
+      cpu.write(sp - 1, b);
+      cpu.write(sp - 2, cpu.C);
+      cpu.write(sp - 3, hl >> 8);
+      cpu.write(sp - 4, hl & 0xff);
+      sprite = cpu.read(de);
+      uint16_t pixels = (sprite << amount) | ((below << amount) >> 8);
+      below = 0;
+      cpu.write(hl, draw(pixels & 0xff, cpu.read(hl)));
+      a = draw(pixels >> 8, cpu.read(hl + 1));
+      cpu.write(hl + 1, a);
+      de++;
+      hl = (cpu.read(sp - 4) | cpu.read(sp - 3) << 8) + 0x20;
+      cpu.C = cpu.read(sp - 2);
+      b = cpu.read(sp - 1) - 1;
+      done++;
+      if (b == 0) {
+        break;
+      }
+    }
+    n = done;
+  }
+  // The last OUT 4 wrote 0 over the last sprite byte
+  cpu.shifter.value = sprite;
+  cpu.shifter.update();
+
+  cpu.A = a;
+  cpu.B = b;
+  cpu.DE = de;
+  cpu.HL = hl;
+  // ORA and ANA clear CY, DAD leaves it and DCR B sets the rest
+  cpu.f.CY = false;
+  cpu.f.Z = cpu.zero(b);
+  cpu.f.S = cpu.sign(b);
+  cpu.f.P = cpu.parity(b);
+
+  cpu.pc = b == 0 ? exit : entry;
+  cpu.cycles += n * perIteration;
+  return n;
+}
+} // namespace
+
+const std::vector<HleRoutine> &hleRoutines() {
+  static const std::vector<HleRoutine> routines = {
+      {"BlockCopy", 0x1a32, {0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2, 0x32, 0x1a},
+       6, blockCopy},
+      {"ClearScreen",
+       0x1a5f,
+       {0x36, 0x00, 0x23, 0x7c, 0xfe, 0x40, 0xc2, 0x5f, 0x1a},
+       5,
+       clearScreen},
+      {"DrawShifted",
+       0x1404,
+       {0xc5, 0xe5, 0x1a, 0xd3, 0x04, 0xdb, 0x03, 0xb6, 0x77, 0x23,
+        0x13, 0xaf, 0xd3, 0x04, 0xdb, 0x03, 0xb6, 0x77, 0xe1, 0x01,
+        0x20, 0x00, 0x09, 0xc1, 0x05, 0xc2, 0x04, 0x14},
+       20,
+       shiftedSprite<false>},
+      {"EraseShifted",
+       0x1427,
+       {0xc5, 0xe5, 0x1a, 0xd3, 0x04, 0xdb, 0x03, 0x2f, 0xa6, 0x77,
+        0x23, 0x13, 0xaf, 0xd3, 0x04, 0xdb, 0x03, 0x2f, 0xa6, 0x77,
+        0xe1, 0x01, 0x20, 0x00, 0x09, 0xc1, 0x05, 0xc2, 0x27, 0x14},
+       22,
+       shiftedSprite<true>},
+  };
+  return routines;
+}
+
+std::shared_ptr<const Hle> Hle::forRom(const RomImage &image,
+                                       const std::vector<std::string> &off) {
+  auto hle = std::make_shared<Hle>();
+  hle->romHash = image.hash();
+  for (const HleRoutine &r : hleRoutines()) {
+    bool disabled = std::find(off.begin(), off.end(), r.name) != off.end();
+    bool matches = r.entry + r.code.size() <= RomImage::size &&
+                   std::equal(r.code.begin(), r.code.end(),
+                              image.data() + r.entry);
+    if (!disabled && matches) {
+      hle->active.push_back(&r);
+      hle->byEntry[r.entry] = &r;
+    }
+  }
+  return hle;
+}
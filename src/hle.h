@@ -0,0 +1,51 @@
+#ifndef hle_h
+#define hle_h
+#include "./emu.h"
+#include "./rom.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* High level emulation of hot ROM loops. A routine is known by its entry
+ * address and the code found there, so it only applies to ROMs that have
+ * exactly that code. When pc reaches the entry, native code does the work
+ * of as many whole iterations as end by limit, leaving memory, registers,
+ * flags, pc and cycles as the interpreter would, and the interpreter
+ * carries on from there.
+ */
+struct HleRoutine {
+  const char *name;
+  uint16_t entry;
+  std::vector<uint8_t> code;
+  // Instructions in one iteration of the loop
+  uint32_t instructions;
+  // Returns the iterations done, 0 if none fit before limit
+  uint32_t (*run)(intel8080 &cpu, uint32_t limit);
+};
+
+// The built-in routines
+const std::vector<HleRoutine> &hleRoutines();
+
+/* The routines that apply to one ROM image, by entry address. Shared by
+ * every Machine running that image, like the image itself.
+ */
+struct Hle {
+  // Routines whose code matches the image, except the ones named in off
+  static std::shared_ptr<const Hle> forRom(
+      const RomImage &image, const std::vector<std::string> &off = {});
+
+  uint64_t romHash = 0;
+  std::vector<const HleRoutine *> active;
+
+  const HleRoutine *at(uint16_t pc) const {
+    return pc < RomImage::size ? byEntry[pc] : nullptr;
+  }
+
+private:
+  std::vector<const HleRoutine *> byEntry =
+      std::vector<const HleRoutine *>(RomImage::size);
+};
+
+#endif /* hle_h */
@@ -0,0 +1,82 @@
+#include "./io.h"
+#include "./sound.h"
+
+namespace {
+uint8_t unmappedIn(intel8080 &cpu, uint8_t) { return cpu.A; }
+void unmappedOut(intel8080 &, uint8_t, uint8_t) {}
+
+uint8_t read0(intel8080 &cpu, uint8_t) { return cpu.Read0; }
+uint8_t read1(intel8080 &cpu, uint8_t) { return cpu.Read1; }
+
+// The result only changes on writes, so reading it is a load
+uint8_t shiftResult(intel8080 &cpu, uint8_t) { return cpu.shifter.result; }
+
+void shiftAmount(intel8080 &cpu, uint8_t, uint8_t val) {
+  cpu.shifter.amount = val & 0x7;
+  cpu.shifter.update();
+}
+
+void shiftData(intel8080 &cpu, uint8_t, uint8_t val) {
+  // The new byte goes in the top half, the old top half moves down
+  cpu.shifter.value = (val << 8) | (cpu.shifter.value >> 8);
+  cpu.shifter.update();
+}
+
+void soundOut(intel8080 &cpu, uint8_t port, uint8_t val) {
+  if (cpu.sound != nullptr) {
+    cpu.sound->portWrite(port, val, cpu.cycles);
+  }
+}
+} // namespace
+
+const IoPorts *defaultPorts() { return &IoPorts::invaders(); }
+
+IoPorts::IoPorts() {
+  in.fill(unmappedIn);
+  out.fill(unmappedOut);
+}
+
+const IoPorts &IoPorts::invaders() {
+  static const IoPorts ports = [] {
+    IoPorts p;
+    devices::inputs(p);
+    devices::shifter(p);
+    devices::sound(p);
+    devices::watchdog(p);
+    return p;
+  }();
+  return ports;
+}
+
+const IoPorts &IoPorts::silent() {
+  static const IoPorts ports = [] {
+    IoPorts p;
+    devices::inputs(p);
+    devices::shifter(p);
+    devices::watchdog(p);
+    return p;
+  }();
+  return ports;
+}
+
+void devices::inputs(IoPorts &ports) {
+  ports.in[1] = read0;
+  ports.in[2] = read1;
+}
+
+void devices::shifter(IoPorts &ports) {
+  ports.out[2] = shiftAmount;
+  ports.out[4] = shiftData;
+  ports.in[3] = shiftResult;
+}
+
+void devices::sound(IoPorts &ports) {
+  ports.out[3] = soundOut;
+  ports.out[5] = soundOut;
+}
+
+void devices::watchdog(IoPorts &ports) {
+  // It would reset a board that stopped writing; an emulator that stops
+  // has nothing to reset, so writes are only accepted
+  ports.out[6] = unmappedOut;
+}
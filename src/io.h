@@ -0,0 +1,42 @@
+#ifndef io_h
+#define io_h
+#include "./emu.h"
+
+#include <array>
+#include <cstdint>
+
+/* The I/O bus: an IN and an OUT handler for each of the 256 ports, so IN
+ * and OUT are one indirect call whatever the port. Handlers get the CPU and
+ * keep device state in it (Read0/Read1, shifter), so a table can be shared
+ * by every Machine and stays valid when one is copied. A table starts with
+ * every port unmapped and the devices attach themselves to their ports.
+ */
+using PortIn = uint8_t (*)(intel8080 &cpu, uint8_t port);
+using PortOut = void (*)(intel8080 &cpu, uint8_t port, uint8_t val);
+
+struct IoPorts {
+  std::array<PortIn, 256> in;
+  std::array<PortOut, 256> out;
+
+  // Unmapped ports: IN leaves A as it was, OUT does nothing
+  IoPorts();
+
+  // The Space Invaders board: inputs, shifter, sound and watchdog
+  static const IoPorts &invaders();
+  // The same without sound, for headless runs
+  static const IoPorts &silent();
+};
+
+// The board's devices
+namespace devices {
+// IN 1 and 2: Read0 and Read1
+void inputs(IoPorts &ports);
+// OUT 2 (shift amount), OUT 4 (data) and IN 3 (result)
+void shifter(IoPorts &ports);
+// OUT 3 and 5, passed on to intel8080::sound when set
+void sound(IoPorts &ports);
+// OUT 6, which the game keeps writing to
+void watchdog(IoPorts &ports);
+} // namespace devices
+
+#endif /* io_h */
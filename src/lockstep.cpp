@@ -0,0 +1,929 @@
+#include "./lockstep.h"
+#include "./dispatcher.h"
+#include "./io.h"
+#include "./sound.h"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+using u8x32 = Lockstep::u8x32;
+using u16x32 = Lockstep::u16x32;
+using u32x32 = Lockstep::u32x32;
+typedef int8_t i8x32 __attribute__((vector_size(32)));
+typedef int16_t i16x32 __attribute__((vector_size(64)));
+typedef int32_t i32x32 __attribute__((vector_size(128)));
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+typedef uint16_t u16x16 __attribute__((vector_size(32), may_alias));
+
+constexpr int M = 6; // (HL) in the register field of an opcode
+constexpr int A = 7;
+
+// Bit i of the result is set if lane i is non-zero
+uint32_t bits(u8x32 m) {
+#if defined(__AVX2__)
+  __m256i v;
+  __builtin_memcpy(&v, &m, sizeof(v));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+#else
+  uint32_t b = 0;
+  for (int i = 0; i < Lockstep::maxLanes; ++i) {
+    b |= static_cast<uint32_t>(m[i] != 0) << i;
+  }
+  return b;
+#endif
+}
+
+// Bit i of the result is set if lane i of v is x. Compared a half at a
+// time: without AVX-512, GCC compares 64-byte vectors one lane at a time.
+uint32_t lanesAt(const u16x32 &v, uint16_t x) {
+  const u16x16 *half = reinterpret_cast<const u16x16 *>(&v);
+  u8x16 lo = __builtin_convertvector((u16x16)(half[0] == x), u8x16);
+  u8x16 hi = __builtin_convertvector((u16x16)(half[1] == x), u8x16);
+  return bits(__builtin_shufflevector(lo, hi, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+                                      10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+                                      20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                      30, 31));
+}
+
+// Lane i of the result is 0xff if bit i is set
+u8x32 mask8(uint32_t bits) {
+  u8x32 m;
+  for (int i = 0; i < Lockstep::maxLanes; ++i) {
+    m[i] = (bits >> i) & 1 ? 0xff : 0x00;
+  }
+  return m;
+}
+
+// The 16 and 32 bit vectors are 64 and 128 bytes, which only AVX-512 passes
+// in registers: GCC warns (-Wpsabi) about any function, inlined or not,
+// that takes or returns one by value. Their conversions are macros.
+#define WIDE(v) __builtin_convertvector((v), u16x32)
+#define NARROW(v) __builtin_convertvector((v), u8x32)
+// 0xff/0x00 lane masks at 16 and 32 bits
+#define MASK16(m) ((u16x32)__builtin_convertvector((i8x32)(m), i16x32))
+#define MASK32(m) ((u32x32)__builtin_convertvector((i8x32)(m), i32x32))
+// a where m is set, b elsewhere
+#define SEL(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+// Comparison result (-1/0) to a 0/1 flag
+u8x32 flag(u8x32 cmp) { return cmp & 1; }
+
+u8x32 parity(u8x32 v) {
+  u8x32 x = v ^ (v >> 4);
+  x ^= x >> 2;
+  x ^= x >> 1;
+  return ~x & 1;
+}
+
+u8x32 splat(uint8_t x) { return u8x32{} + x; }
+
+intel8080 &cpu(Machine *m) { return m->cpu; }
+} // namespace
+
+Lockstep::Lockstep(const std::vector<Machine *> &machines)
+    : machines(machines),
+      lanes(static_cast<int>(machines.size()) < maxLanes
+                ? static_cast<int>(machines.size())
+                : maxLanes) {
+  for (auto &reg : r) {
+    reg = u8x32{};
+  }
+  Z = S = P = CY = AC = interrupts = u8x32{};
+  pc = sp = u16x32{};
+  cycles = u32x32{};
+  mask = u8x32{};
+  mask16Bits = u16x32{};
+  mask32Bits = u32x32{};
+}
+
+void Lockstep::load(int i) {
+  const intel8080 &c = cpu(machines[i]);
+  r[0][i] = c.B;
+  r[1][i] = c.C;
+  r[2][i] = c.D;
+  r[3][i] = c.E;
+  r[4][i] = c.H;
+  r[5][i] = c.L;
+  r[A][i] = c.A;
+  Z[i] = c.f.Z;
+  S[i] = c.f.S;
+  P[i] = c.f.P;
+  CY[i] = c.f.CY;
+  AC[i] = c.f.AC;
+  interrupts[i] = c.interrupts;
+  pc[i] = c.pc;
+  sp[i] = c.sp;
+  cycles[i] = c.cycles;
+}
+
+void Lockstep::store(int i) {
+  intel8080 &c = cpu(machines[i]);
+  c.B = r[0][i];
+  c.C = r[1][i];
+  c.D = r[2][i];
+  c.E = r[3][i];
+  c.H = r[4][i];
+  c.L = r[5][i];
+  c.A = r[A][i];
+  c.f.Z = Z[i];
+  c.f.S = S[i];
+  c.f.P = P[i];
+  c.f.CY = CY[i];
+  c.f.AC = AC[i];
+  c.interrupts = interrupts[i];
+  c.pc = pc[i];
+  c.sp = sp[i];
+  c.cycles = cycles[i];
+}
+
+void Lockstep::flush() {
+  // Every lane of the group ran every step since it last changed
+  if (groupSteps != 0) {
+    for (uint32_t b = group; b != 0; b &= b - 1) {
+      machines[__builtin_ctz(b)]->instructions += groupSteps;
+    }
+    vectorInstructions += groupSteps * __builtin_popcount(group);
+    groupSteps = 0;
+  }
+  // Lanes that join may be close to their interrupt: check before the
+  // next step
+  checkIn = 0;
+}
+
+void Lockstep::join(uint32_t lanes) {
+  flush();
+  for (uint32_t b = lanes; b != 0; b &= b - 1) {
+    load(__builtin_ctz(b));
+  }
+  group |= lanes;
+  waiting &= ~lanes;
+  groupPc = pc[__builtin_ctz(group)];
+}
+
+void Lockstep::leave(uint32_t lanes) {
+  flush();
+  for (uint32_t b = lanes; b != 0; b &= b - 1) {
+    store(__builtin_ctz(b));
+  }
+  group &= ~lanes;
+  waiting |= lanes;
+}
+
+void Lockstep::findLow() {
+  // A lane alone is cheaper on its own Machine than in the vectors
+  if (__builtin_popcount(group) == 1) {
+    leave(group);
+  }
+  low = 0x10000;
+  atLow = 0;
+  for (uint32_t b = waiting; b != 0; b &= b - 1) {
+    int i = __builtin_ctz(b);
+    uint16_t p = cpu(machines[i]).pc;
+    if (p < low) {
+      low = p;
+      atLow = 1u << i;
+    } else if (p == low) {
+      atLow |= 1u << i;
+    }
+  }
+}
+
+void Lockstep::settle() {
+  // Same order as Machine::runToInterrupt: the stall is checked after the
+  // step that crossed it, the interrupt before the next one
+  uint32_t room = stallCycles;
+  for (uint32_t b = group; b != 0; b &= b - 1) {
+    int i = __builtin_ctz(b);
+    uint32_t used = cycles[i] - start[i];
+    if (used > stallCycles) {
+      leave(1u << i);
+      waiting &= ~(1u << i);
+      stalled |= 1u << i;
+    } else if (interrupts[i] && cycles[i] >= Machine::halfFrameCycles) {
+      leave(1u << i);
+      waiting &= ~(1u << i);
+      machines[i]->deliverInterrupt();
+    } else {
+      room = std::min(room, stallCycles - used);
+      // Lanes with interrupts disabled have to go through EI first, and
+      // vectorStep checks again after one
+      if (interrupts[i]) {
+        room = std::min(room, Machine::halfFrameCycles - cycles[i]);
+      }
+    }
+  }
+  findLow();
+  // No instruction takes more than 18 cycles, so none of the lanes can get
+  // to either check in the first room / 18 - 1 steps; the one after those
+  // may, and is checked before the group goes on
+  uint32_t safe = room / 18 > 0 ? room / 18 - 1 : 0;
+  checkIn = safe + 1;
+}
+
+void Lockstep::vectorStep() {
+  // The whole group is at groupPc. The code there may differ if it's not in
+  // the shared ROM, and then each lane runs its own instruction.
+  uint8_t op;
+  bool same = true;
+  if (rom != nullptr && groupPc < romEnd) {
+    op = rom[groupPc];
+  } else {
+    op = cpu(machines[__builtin_ctz(group)]).read(groupPc);
+    for (uint32_t b = group; b != 0; b &= b - 1) {
+      same = same && cpu(machines[__builtin_ctz(b)]).read(groupPc) == op;
+    }
+  }
+  if (!same || op == 0xfb) {
+    // EI, maybe in some lanes only: their interrupt may be due already
+    checkIn = 0;
+  }
+  if (same && execute(op, group)) {
+    groupSteps++;
+  } else {
+    for (uint32_t b = group; b != 0; b &= b - 1) {
+      int i = __builtin_ctz(b);
+      store(i);
+      cpu(machines[i]).emulateCycle();
+      load(i);
+      machines[i]->instructions++;
+    }
+    scalarInstructions += __builtin_popcount(group);
+  }
+
+  // Only jumps, calls and returns ($c0 and up), or code that differs, can
+  // send lanes apart
+  int lead = __builtin_ctz(group);
+  if (op >= 0xc0 || !same) {
+    uint32_t apart = group & ~lanesAt(pc, pc[lead]);
+    if (apart != 0) {
+      // The lanes furthest behind go on together and the others wait
+      // for them to catch up
+      uint16_t lowest = pc[lead];
+      for (uint32_t b = apart; b != 0; b &= b - 1) {
+        lowest = std::min<uint16_t>(lowest, pc[__builtin_ctz(b)]);
+      }
+      uint32_t behind = lanesAt(pc, lowest);
+      leave(group & ~behind);
+      findLow();
+      if (group == 0) {
+        return;
+      }
+      lead = __builtin_ctz(group);
+    }
+  }
+  groupPc = pc[lead];
+}
+
+void Lockstep::runAlone(int i, uint32_t target) {
+  // Machine::runToInterrupt on one lane, stopping once its pc gets to
+  // target
+  Machine &m = *machines[i];
+  intel8080 &c = m.cpu;
+  uint64_t done = 0;
+  for (;;) {
+    if (c.interrupts && c.cycles >= Machine::halfFrameCycles) {
+      m.deliverInterrupt();
+      waiting &= ~(1u << i);
+      break;
+    }
+    c.emulateCycle();
+    done++;
+    if (c.cycles - start[i] > stallCycles) {
+      waiting &= ~(1u << i);
+      stalled |= 1u << i;
+      break;
+    }
+    if (c.pc >= target) {
+      break;
+    }
+  }
+  m.instructions += done;
+  scalarInstructions += done;
+}
+
+uint32_t Lockstep::runHalfFrame(uint32_t running) {
+  // Opcodes and operands in ROM can be fetched once for all lanes when
+  // they share the image
+  rom = cpu(machines[0]).rom;
+  romEnd = cpu(machines[0]).romEnd;
+  for (int i = 1; i < lanes; ++i) {
+    if (cpu(machines[i]).rom != rom || cpu(machines[i]).romEnd != romEnd) {
+      rom = nullptr;
+    }
+  }
+
+  for (uint32_t b = running; b != 0; b &= b - 1) {
+    int i = __builtin_ctz(b);
+    start[i] = cpu(machines[i]).cycles;
+  }
+  group = 0;
+  waiting = running;
+  stalled = 0;
+  groupSteps = 0;
+  checkIn = 0;
+  findLow();
+
+  // Whatever is furthest behind in the code runs next: the group while it
+  // is, else the lanes waiting at the lowest pc. Lanes that split at a
+  // branch meet again where the paths join, and at loops.
+  while ((group | waiting) != 0) {
+    if (group != 0 && groupPc < low) {
+      if (checkIn == 0) {
+        settle();
+      } else {
+        checkIn--;
+        vectorStep();
+      }
+    } else if (group != 0 && groupPc == low) {
+      join(atLow);
+      findLow();
+    } else if (__builtin_popcount(atLow) >= 2) {
+      leave(group);
+      join(atLow);
+      findLow();
+    } else {
+      // Alone at the lowest pc, until it catches up with the group or
+      // another lane
+      int i = __builtin_ctz(atLow);
+      uint32_t target = group != 0 ? groupPc : 0x10000;
+      for (uint32_t b = waiting & ~(1u << i); b != 0; b &= b - 1) {
+        uint16_t p = cpu(machines[__builtin_ctz(b)]).pc;
+        target = std::min<uint32_t>(target, p);
+      }
+      runAlone(i, target);
+      findLow();
+    }
+  }
+  return stalled;
+}
+
+bool Lockstep::stepHalfFrame() { return runHalfFrame(allLanes()) == 0; }
+
+bool Lockstep::stepFrame() {
+  // A lane that stalls skips its second half, like Machine::stepFrame
+  uint32_t stalled = runHalfFrame(allLanes());
+  stalled |= runHalfFrame(allLanes() & ~stalled);
+  for (int i = 0; i < lanes; ++i) {
+    if (!(stalled >> i & 1)) {
+      machines[i]->frames++;
+    }
+  }
+  return stalled == 0;
+}
+
+bool Lockstep::execute(uint8_t op, uint32_t group) {
+  // The group is nearly always the same as on the previous instruction
+  if (group != maskBits) {
+    maskBits = group;
+    mask = mask8(group);
+    mask16Bits = MASK16(mask);
+    mask32Bits = MASK32(mask);
+  }
+  const u8x32 m = mask;
+  const u16x32 m16 = mask16Bits;
+  const u32x32 m32 = mask32Bits;
+
+  // Per-lane memory accesses, using the same addressing as the handlers,
+  // in the whole group or in some of its lanes
+  auto readIn = [&](uint32_t lanes, auto addr) {
+    u8x32 v{};
+    for (uint32_t b = lanes; b != 0; b &= b - 1) {
+      int i = __builtin_ctz(b);
+      v[i] = cpu(machines[i]).read(addr(i));
+    }
+    return v;
+  };
+  auto writeIn = [&](uint32_t lanes, auto addr, u8x32 v) {
+    for (uint32_t b = lanes; b != 0; b &= b - 1) {
+      int i = __builtin_ctz(b);
+      cpu(machines[i]).write(addr(i), v[i]);
+    }
+  };
+  auto read = [&](auto addr) { return readIn(group, addr); };
+  auto write = [&](auto addr, u8x32 v) { writeIn(group, addr, v); };
+  auto HL = [&](int i) { return (r[4][i] << 8) | r[5][i]; };
+  auto BC = [&](int i) { return (r[0][i] << 8) | r[1][i]; };
+  auto DE = [&](int i) { return (r[2][i] << 8) | r[3][i]; };
+  auto SP = [&](int k) {
+    return [&, k](int i) { return static_cast<uint16_t>(sp[i] + k); };
+  };
+  // Operand bytes. The whole group is at the same pc, so in the shared ROM
+  // they are read once for every lane.
+  const uint16_t at = pc[__builtin_ctz(group)];
+  auto imm = [&](int k) {
+    if (rom != nullptr && at + k < romEnd) {
+      return splat(rom[at + k]);
+    }
+    return read([&](int i) { return pc[i] + k; });
+  };
+
+  auto retire = [&](uint16_t length, uint32_t opCycles) {
+    pc += m16 & length;
+    cycles += m32 & opCycles;
+  };
+  auto set = [&](u8x32 &reg, u8x32 v) { reg = SEL(m, v, reg); };
+  auto setZSP = [&](u8x32 v) {
+    set(Z, flag((u8x32)(v == 0)));
+    set(S, v >> 7);
+    set(P, parity(v));
+  };
+#define PAIR(hi, lo) ((WIDE(r[hi]) << 8) | WIDE(r[lo]))
+  auto setPair = [&](int hi, int lo, const u16x32 &v) {
+    set(r[hi], NARROW(v >> 8));
+    set(r[lo], NARROW(v));
+  };
+  // 0xff in the lanes where the condition of a conditional jump, call or
+  // return holds: NZ Z NC C PO PE P M
+  auto condition = [&]() {
+    const u8x32 *flags[4] = {&Z, &CY, &P, &S};
+    u8x32 f = *flags[(op >> 4) & 3];
+    return (op & 0x08) != 0 ? (u8x32)(f != 0) : (u8x32)(f == 0);
+  };
+
+  // NOP
+  if ((op & 0xc7) == 0x00) {
+    retire(1, 4);
+    return true;
+  }
+
+  // MOV
+  if (op >= 0x40 && op < 0x80 && op != 0x76) {
+    int dst = (op >> 3) & 7;
+    int src = op & 7;
+    if (src == M) {
+      set(r[dst], read(HL));
+      retire(1, 7);
+    } else if (dst == M) {
+      write(HL, r[src]);
+      retire(1, 7);
+    } else {
+      set(r[dst], r[src]);
+      retire(1, 5);
+    }
+    return true;
+  }
+
+  // INR / DCR
+  if ((op & 0xc6) == 0x04) {
+    int reg = (op >> 3) & 7;
+    u8x32 v = reg == M ? read(HL) : r[reg];
+    v = (op & 1) != 0 ? v - 1 : v + 1;
+    setZSP(v);
+    if (reg == M) {
+      write(HL, v);
+      retire(1, 10);
+    } else {
+      set(r[reg], v);
+      retire(1, 5);
+    }
+    return true;
+  }
+
+  // MVI
+  if ((op & 0xc7) == 0x06) {
+    int reg = (op >> 3) & 7;
+    u8x32 v = imm(1);
+    if (reg == M) {
+      write(HL, v);
+      retire(2, 10);
+    } else {
+      set(r[reg], v);
+      retire(2, 7);
+    }
+    return true;
+  }
+
+  // ADD ADC SUB SBB ANA XRA ORA CMP
+  if (op >= 0x80 && op < 0xc0) {
+    int src = op & 7;
+    u8x32 v = src == M ? read(HL) : r[src];
+    u8x32 &a = r[A];
+    switch ((op >> 3) & 7) {
+    case 0: // ADD: flags come from the operand, like intel8080::ADD
+      set(CY, flag((u8x32)(a > 0xff - v)));
+      set(a, a + v);
+      setZSP(src == A ? a : v);
+      break;
+    case 1: { // ADC
+      u8x32 carry = flag((u8x32)(a > 0xff - v));
+      set(CY, carry);
+      set(a, a + v + carry);
+      setZSP(src == A ? a : v);
+      break;
+    }
+    case 2: // SUB
+      set(a, a - v);
+      set(Z, splat(1));
+      set(CY, u8x32{});
+      set(P, splat(1));
+      set(S, u8x32{});
+      break;
+    case 3: { // SBB: borrows when v + CY is more than a
+      u8x32 borrow = flag((u8x32)(a < v)) | (flag((u8x32)(a == v)) & CY);
+      set(a, a - v - CY);
+      setZSP(a);
+      set(CY, borrow);
+      break;
+    }
+    case 4: // ANA
+      set(a, a & v);
+      setZSP(a);
+      set(CY, u8x32{});
+      break;
+    case 5: // XRA
+      set(a, a ^ v);
+      setZSP(a);
+      set(CY, u8x32{});
+      break;
+    case 6: // ORA
+      set(a, a | v);
+      setZSP(a);
+      set(CY, u8x32{});
+      break;
+    case 7: // CMP
+      set(CY, flag((u8x32)(a < v)));
+      setZSP(a - v);
+      break;
+    }
+    retire(1, src == M ? 7 : 4);
+    return true;
+  }
+
+  switch (op) {
+  case 0x01: // LXI B
+  case 0x11: // LXI D
+  case 0x21: // LXI H
+    set(r[(op >> 3) & 6], imm(2));
+    set(r[((op >> 3) & 6) + 1], imm(1));
+    retire(3, 10);
+    return true;
+
+  case 0x31: // LXI SP
+    sp = SEL(m16, (WIDE(imm(2)) << 8) | WIDE(imm(1)), sp);
+    retire(3, 10);
+    return true;
+
+  case 0x03: // INX B
+  case 0x13: // INX D
+  case 0x23: { // INX H
+    int hi = (op >> 3) & 6;
+    setPair(hi, hi + 1, PAIR(hi, hi + 1) + 1);
+    retire(1, 5);
+    return true;
+  }
+
+  case 0x33: // INX SP
+    sp += m16 & 1;
+    retire(1, 5);
+    return true;
+
+  case 0x0b: // DCX B
+  case 0x1b: // DCX D
+  case 0x2b: { // DCX H
+    int hi = (op >> 3) & 6;
+    setPair(hi, hi + 1, PAIR(hi, hi + 1) - 1);
+    retire(1, 5);
+    return true;
+  }
+
+  case 0x3b: // DCX SP
+    sp -= m16 & 1;
+    retire(1, 5);
+    return true;
+
+  case 0x09: // DAD B
+  case 0x19: // DAD D
+  case 0x29: { // DAD H
+    int hi = (op >> 3) & 6;
+    setPair(4, 5, PAIR(4, 5) + PAIR(hi, hi + 1));
+    retire(1, 10);
+    return true;
+  }
+
+  case 0x39: // DAD SP
+    setPair(4, 5, PAIR(4, 5) + sp);
+    retire(1, 10);
+    return true;
+
+  case 0xeb: { // XCHG
+    u8x32 h = r[4], l = r[5];
+    set(r[4], r[2]);
+    set(r[5], r[3]);
+    set(r[2], h);
+    set(r[3], l);
+    retire(1, 5);
+    return true;
+  }
+
+  case 0x2f: // CMA
+    set(r[A], ~r[A]);
+    retire(1, 4);
+    return true;
+
+  case 0x37: // STC
+    set(CY, splat(1));
+    retire(1, 4);
+    return true;
+
+  case 0x3f: // CMC, which intel8080 implements as a clear
+    set(CY, u8x32{});
+    retire(1, 4);
+    return true;
+
+  case 0x07: { // RLC
+    u8x32 a = r[A];
+    set(CY, a >> 7);
+    set(r[A], a << 1);
+    retire(1, 4);
+    return true;
+  }
+
+  case 0x0f: { // RRC
+    u8x32 a = r[A];
+    set(CY, a & 1);
+    set(r[A], (a << 7) | (a >> 1));
+    retire(1, 4);
+    return true;
+  }
+
+  case 0x17: { // RAL
+    u8x32 a = r[A];
+    set(r[A], (a << 1) | CY);
+    set(CY, a >> 7);
+    retire(1, 4);
+    return true;
+  }
+
+  case 0x1f: { // RAR
+    u8x32 a = r[A];
+    set(r[A], (CY << 7) | (a >> 1));
+    set(CY, a & 1);
+    retire(1, 4);
+    return true;
+  }
+
+  case 0xfb: // EI
+  case 0xf3: // DI
+    set(interrupts, splat(op == 0xfb ? 1 : 0));
+    retire(1, 4);
+    return true;
+
+  case 0xc6: { // ADI
+    u8x32 v = imm(1);
+    set(CY, flag((u8x32)(r[A] > 0xff - v)));
+    set(r[A], r[A] + v);
+    setZSP(r[A]);
+    retire(2, 7);
+    return true;
+  }
+
+  case 0xd6: { // SUI
+    u8x32 v = imm(1);
+    set(CY, flag((u8x32)(r[A] < v)));
+    set(r[A], r[A] - v);
+    setZSP(r[A]);
+    retire(2, 7);
+    return true;
+  }
+
+  case 0xde: { // SBI
+    u8x32 v = imm(1);
+    u8x32 a = r[A];
+    u8x32 borrow = flag((u8x32)(a < v)) | (flag((u8x32)(a == v)) & CY);
+    set(r[A], a - v - CY);
+    set(CY, borrow);
+    setZSP(r[A]);
+    retire(2, 7);
+    return true;
+  }
+
+  case 0xe6: // ANI
+    set(r[A], r[A] & imm(1));
+    setZSP(r[A]);
+    set(CY, u8x32{});
+    retire(2, 7);
+    return true;
+
+  case 0xf6: { // ORI
+    u8x32 v = imm(1);
+    set(CY, flag((u8x32)(r[A] > 0xff - v)));
+    set(r[A], r[A] | v);
+    setZSP(r[A]);
+    retire(2, 7);
+    return true;
+  }
+
+  case 0xfe: { // CPI
+    u8x32 v = imm(1);
+    set(CY, flag((u8x32)(r[A] < v)));
+    setZSP(r[A] - v);
+    retire(2, 7);
+    return true;
+  }
+
+  case 0xc2: // JNZ
+  case 0xc3: // JMP
+  case 0xca: // JZ
+  case 0xcb: // JMP
+  case 0xd2: // JNC
+  case 0xda: // JC
+  case 0xe2: // JPO
+  case 0xea: // JPE
+  case 0xf2: // JP
+  case 0xfa: { // JM
+    u8x32 taken = op == 0xc3 || op == 0xcb ? splat(0xff) : condition();
+    u16x32 target = WIDE(imm(1)) | (WIDE(imm(2)) << 8);
+    u16x32 jump = m16 & MASK16(taken);
+    pc = SEL(jump, target, SEL(m16, pc + 3, pc));
+    cycles += m32 & 10;
+    return true;
+  }
+
+  case 0x02: // STAX B
+  case 0x12: // STAX D
+    if (op == 0x02) {
+      write(BC, r[A]);
+    } else {
+      write(DE, r[A]);
+    }
+    retire(1, 7);
+    return true;
+
+  case 0x0a: // LDAX B
+  case 0x1a: // LDAX D
+    set(r[A], op == 0x0a ? read(BC) : read(DE));
+    retire(1, 7);
+    return true;
+
+  case 0x22: // SHLD
+  case 0x2a: // LHLD
+  case 0x32: // STA
+  case 0x3a: { // LDA
+    u8x32 lo = imm(1), hi = imm(2);
+    auto adr = [&](int k) {
+      return [&, k](int i) {
+        return static_cast<uint16_t>(((hi[i] << 8) | lo[i]) + k);
+      };
+    };
+    if (op == 0x22) {
+      write(adr(0), r[5]);
+      write(adr(1), r[4]);
+      retire(3, 16);
+    } else if (op == 0x2a) {
+      u8x32 l = read(adr(0));
+      set(r[4], read(adr(1)));
+      set(r[5], l);
+      retire(3, 16);
+    } else if (op == 0x32) {
+      write(adr(0), r[A]);
+      retire(3, 13);
+    } else {
+      set(r[A], read(adr(0)));
+      retire(3, 13);
+    }
+    return true;
+  }
+
+  case 0xc5: // PUSH B
+  case 0xd5: // PUSH D
+  case 0xe5: // PUSH H
+  case 0xf5: { // PUSH PSW
+    int hi = op == 0xf5 ? A : (op >> 3) & 6;
+    u8x32 lo = op == 0xf5
+                   ? (CY | (P << 2) | (AC << 4) | (Z << 6) | (S << 7) | 2)
+                   : r[hi + 1];
+    write(SP(-1), r[hi]);
+    write(SP(-2), lo);
+    sp -= m16 & 2;
+    retire(1, 11);
+    return true;
+  }
+
+  case 0xc1: // POP B
+  case 0xd1: // POP D
+  case 0xe1: // POP H
+  case 0xf1: { // POP PSW
+    u8x32 hi = read(SP(1)), lo = read(SP(0));
+    if (op == 0xf1) {
+      set(r[A], hi);
+      set(CY, lo & 1);
+      set(P, (lo >> 2) & 1);
+      set(AC, (lo >> 4) & 1);
+      set(Z, (lo >> 6) & 1);
+      set(S, lo >> 7);
+    } else {
+      set(r[(op >> 3) & 6], hi);
+      set(r[((op >> 3) & 6) + 1], lo);
+    }
+    sp += m16 & 2;
+    retire(1, 10);
+    return true;
+  }
+
+  case 0xe3: { // XTHL
+    u8x32 hi = read(SP(1)), lo = read(SP(0));
+    write(SP(1), r[4]);
+    write(SP(0), r[5]);
+    set(r[4], hi);
+    set(r[5], lo);
+    retire(1, 18);
+    return true;
+  }
+
+  case 0xe9: // PCHL
+    pc = SEL(m16, PAIR(4, 5), pc);
+    cycles += m32 & 5;
+    return true;
+
+  case 0xf9: // SPHL
+    sp = SEL(m16, PAIR(4, 5), sp);
+    retire(1, 5);
+    return true;
+
+  case 0xc4: // CNZ
+  case 0xcc: // CZ
+  case 0xcd: // CALL
+  case 0xd4: // CNC
+  case 0xdc: // CC
+  case 0xdd: // CALL
+  case 0xe4: // CPO
+  case 0xec: // CPE
+  case 0xed: // CALL
+  case 0xf4: // CP
+  case 0xfc: // CM
+  case 0xfd: { // CALL
+    u8x32 taken = (op & 0x0f) == 0x0d ? splat(0xff) : condition();
+    uint32_t calls = group & bits(taken);
+    u16x32 next = pc + 3;
+    writeIn(calls, SP(-1), NARROW(next >> 8));
+    writeIn(calls, SP(-2), NARROW(next));
+    u16x32 call = m16 & MASK16(taken);
+    u16x32 target = WIDE(imm(1)) | (WIDE(imm(2)) << 8);
+    sp -= call & 2;
+    pc = SEL(call, target, SEL(m16, next, pc));
+    u32x32 call32 = m32 & MASK32(taken);
+    cycles += (call32 & 17) | (m32 & ~call32 & 11);
+    return true;
+  }
+
+  case 0xc0: // RNZ
+  case 0xc8: // RZ
+  case 0xc9: // RET
+  case 0xd0: // RNC
+  case 0xd8: // RC
+  case 0xd9: // RET
+  case 0xe0: // RPO
+  case 0xe8: // RPE
+  case 0xf0: // RP
+  case 0xff: { // RM, where intel8080 has it instead of at $f8
+    u8x32 taken = (op & 0x0f) == 0x09 ? splat(0xff) : condition();
+    uint32_t returns = group & bits(taken);
+    u16x32 target = WIDE(readIn(returns, SP(0))) |
+                    (WIDE(readIn(returns, SP(1))) << 8);
+    u16x32 ret = m16 & MASK16(taken);
+    sp += ret & 2;
+    pc = SEL(ret, target, SEL(m16, pc + 1, pc));
+    u32x32 ret32 = m32 & MASK32(taken);
+    cycles += (ret32 & 10) | (m32 & ~ret32 & 5);
+    return true;
+  }
+
+  case 0xdb: // IN
+  case 0xd3: { // OUT
+    // Through each lane's port handlers, which see its A and cycles
+    u8x32 port = imm(1);
+    u8x32 a = r[A];
+    for (uint32_t b = group; b != 0; b &= b - 1) {
+      int i = __builtin_ctz(b);
+      intel8080 &c = cpu(machines[i]);
+      c.A = a[i];
+      c.cycles = cycles[i];
+      if (op == 0xdb) {
+        a[i] = c.ports->in[port[i]](c, port[i]);
+      } else {
+        c.ports->out[port[i]](c, port[i], a[i]);
+      }
+    }
+    set(r[A], a);
+    retire(2, 10);
+    return true;
+  }
+
+  default:
+    if (unimplementedOpcodes()[op]) {
+      for (uint32_t b = group; b != 0; b &= b - 1) {
+        intel8080 &c = cpu(machines[__builtin_ctz(b)]);
+        c.unimplemented++;
+        c.lastUnimplemented = op;
+      }
+      cycles += m32 & 4;
+      return true;
+    }
+    return false;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef lockstep_h
+#define lockstep_h
+#include "./machine.h"
+
+#include <cstdint>
+#include <vector>
+
+/* Runs up to 32 machines in lockstep. Registers and flags are kept in
+ * structure-of-arrays form (all A registers in one vector, all B registers
+ * in another...), so when several lanes sit at the same pc, which is the
+ * normal case since they all run the same ROM, the opcode is decoded once
+ * and executed for all of them with vector ALU and flag operations
+ * (AVX2 when the compiler targets it). The lanes furthest behind in the
+ * code run as the group; lanes that leave it at a branch run alone on their
+ * own Machine until their pc meets the group again, and opcodes without a
+ * vector implementation go through intel8080::emulateCycle() lane by lane.
+ * The result matches the scalar core exactly, Machine counters included.
+ */
+struct Lockstep {
+  static constexpr int maxLanes = 32;
+
+  typedef uint8_t u8x32 __attribute__((vector_size(32)));
+  typedef uint16_t u16x32 __attribute__((vector_size(64)));
+  typedef uint32_t u32x32 __attribute__((vector_size(128)));
+
+  // Machines must outlive the Lockstep; at most maxLanes of them
+  explicit Lockstep(const std::vector<Machine *> &machines);
+
+  // Every lane runs to its next interrupt, like Machine::stepHalfFrame().
+  // Returns false if any lane stalled.
+  bool stepHalfFrame();
+  bool stepFrame();
+
+  // Lane-instructions executed by the vector and the scalar paths
+  uint64_t vectorInstructions = 0;
+  uint64_t scalarInstructions = 0;
+
+private:
+  std::vector<Machine *> machines;
+  int lanes;
+
+  // Registers indexed like the opcode fields: B C D E H L (M) A
+  u8x32 r[8];
+  u8x32 Z, S, P, CY, AC; // 0 or 1
+  u8x32 interrupts;
+  u16x32 pc, sp;
+  u32x32 cycles;
+
+  // ROM shared by every lane, or nullptr
+  const uint8_t *rom = nullptr;
+  uint16_t romEnd = 0;
+
+  // Lane masks of the last group executed
+  uint32_t maskBits = 0;
+  u8x32 mask;
+  u16x32 mask16Bits;
+  u32x32 mask32Bits;
+
+  // Lanes in the vector registers, all at groupPc, and lanes still running
+  // whose state is in their Machine
+  uint32_t group = 0, waiting = 0;
+  uint16_t groupPc = 0;
+  // Lowest pc of the waiting lanes (0x10000 with none) and the lanes there
+  uint32_t low = 0x10000, atLow = 0;
+  // Vector steps since the group last changed, not yet counted in the
+  // Machines
+  uint64_t groupSteps = 0;
+  // Group steps left until the stall and interrupt checks
+  uint32_t checkIn = 0;
+  uint32_t start[maxLanes] = {};
+  uint32_t stalled = 0;
+  static constexpr uint32_t stallCycles = Machine::halfFrameCycles * 64;
+
+  void load(int lane);
+  void store(int lane);
+  void flush();
+  void join(uint32_t lanes);
+  void leave(uint32_t lanes);
+  void findLow();
+  void settle();
+  void vectorStep();
+  void runAlone(int lane, uint32_t target);
+
+  uint32_t allLanes() const { return lanes == 32 ? ~0u : (1u << lanes) - 1; }
+  // Returns the lanes that stalled
+  uint32_t runHalfFrame(uint32_t running);
+  bool execute(uint8_t op, uint32_t group);
+};
+
+#endif /* lockstep_h */
@@ -0,0 +1,320 @@
+#include "./machine.h"
+#include "./hle.h"
+#include "./sound.h"
+
+#include <sys/stat.h>
+#include <zip.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+struct RomFile {
+  const char *name;
+  int offset;
+};
+
+const size_t romFileSize = 0x800;
+
+const std::array<RomFile, 4> romFiles = {{
+    {"invaders.h", 0x0000},
+    {"invaders.g", 0x0800},
+    {"invaders.f", 0x1000},
+    {"invaders.e", 0x1800},
+}};
+
+// Exactly one ROM file's worth, straight into dest
+bool loadFile(const char *file, uint8_t *dest) {
+  FILE *ROM = fopen(file, "rb");
+  if (ROM == nullptr) {
+    return false;
+  }
+  bool ok = fread(dest, 1, romFileSize, ROM) == romFileSize &&
+            fgetc(ROM) == EOF;
+  fclose(ROM);
+  return ok;
+}
+
+// The cached image of zipFile: SI_ROM_CACHE/<hash of its path, size and
+// modification time>.rom, or "" when SI_ROM_CACHE isn't set
+std::string cachePath(const char *zipFile) {
+  const char *dir = getenv("SI_ROM_CACHE");
+  struct stat st = {};
+  if (dir == nullptr || stat(zipFile, &st) != 0) {
+    return "";
+  }
+  uint64_t h = 0xcbf29ce484222325ULL;
+  auto add = [&h](const void *p, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      h = (h ^ static_cast<const uint8_t *>(p)[i]) * 0x100000001b3ULL;
+    }
+  };
+  add(zipFile, strlen(zipFile));
+  add(&st.st_size, sizeof(st.st_size));
+  add(&st.st_mtime, sizeof(st.st_mtime));
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.rom",
+           static_cast<unsigned long long>(h));
+  return dir + std::string(name);
+}
+
+// The CRC-32 of each ROM file from the zip's directory, without
+// decompressing anything. False if one is missing or isn't 2 KB.
+bool zipCrcs(zip *z, std::array<uint32_t, 4> &crcs) {
+  for (size_t i = 0; i < romFiles.size(); ++i) {
+    struct zip_stat st = {};
+    zip_stat_init(&st);
+    if (zip_stat(z, romFiles[i].name, 0, &st) != 0 ||
+        !(st.valid & ZIP_STAT_SIZE) || !(st.valid & ZIP_STAT_CRC) ||
+        st.size != romFileSize) {
+      return false;
+    }
+    crcs[i] = st.crc;
+  }
+  return true;
+}
+
+void fnv(uint64_t &h, uint8_t b) {
+  h ^= b;
+  h *= 0x100000001b3ULL;
+}
+} // namespace
+
+Machine::Machine() {
+  setRom(RomImage::blank());
+  reset();
+}
+
+void Machine::setRom(std::shared_ptr<const RomImage> image) {
+  rom = std::move(image);
+  cpu.rom = rom->data();
+  // Made for the previous image
+  hle = nullptr;
+  fusion = nullptr;
+}
+
+void Machine::reset() {
+  // Initialize Program Counter & Stack Pointer
+  cpu.pc = 0x0;
+  cpu.sp = 0xf000;
+  cpu.cycles = 0;
+  cpu.A = cpu.B = cpu.C = cpu.D = cpu.E = cpu.H = cpu.L = 0;
+  cpu.f = 0;
+  cpu.interrupts = false;
+
+  cpu.Read0 = 0x00;
+  cpu.Read1 = 0b10000011;
+  cpu.shifter = {};
+
+  std::fill(cpu.ram.begin(), cpu.ram.end(), 0);
+  cpu.markAllDirty();
+
+  interruptSwitch = false;
+  frames = 0;
+  totalCycles = 0;
+}
+
+bool Machine::loadRomDir(const char *dir) {
+  auto image = RomImage::create();
+  for (const auto &file : romFiles) {
+    std::string path = std::string(dir) + "/" + file.name;
+    if (!loadFile(path.c_str(), image->writableData() + file.offset)) {
+      return false;
+    }
+  }
+  image->seal();
+  setRom(image);
+  return true;
+}
+
+bool Machine::loadRomZip(const char *zipFile) {
+  // A cached image is trusted as it is if it's a known set; anything else
+  // has to match the CRCs in the zip
+  std::string cache = cachePath(zipFile);
+  std::shared_ptr<const RomImage> cached;
+  if (!cache.empty()) {
+    cached = RomImage::map(cache.c_str());
+    if (cached != nullptr && identifyRomSet(romCrcs(*cached)) != nullptr) {
+      setRom(cached);
+      return true;
+    }
+  }
+
+  int32_t err = ZIP_ER_OK;
+  zip *z = zip_open(zipFile, 0, &err);
+  if (err != ZIP_ER_OK || z == nullptr) {
+    return false;
+  }
+  std::array<uint32_t, 4> crcs = {};
+  if (!zipCrcs(z, crcs)) {
+    zip_close(z);
+    return false;
+  }
+  if (cached != nullptr && romCrcs(*cached) == crcs) {
+    zip_close(z);
+    setRom(cached);
+    return true;
+  }
+
+  // Decompressed straight into the image, each file checked against the
+  // CRC the zip has for it
+  auto image = RomImage::create();
+  bool ok = true;
+  for (size_t i = 0; ok && i < romFiles.size(); ++i) {
+    uint8_t *dest = image->writableData() + romFiles[i].offset;
+    zip_file *f = zip_fopen(z, romFiles[i].name, 0);
+    ok = f != nullptr &&
+         zip_fread(f, dest, romFileSize) ==
+             static_cast<zip_int64_t>(romFileSize) &&
+         crc32(dest, romFileSize) == crcs[i];
+    if (f != nullptr) {
+      zip_fclose(f);
+    }
+  }
+  zip_close(z);
+  if (!ok) {
+    return false;
+  }
+
+  image->seal();
+  if (!cache.empty()) {
+    // Only an optimization: a cache that can't be written is skipped
+    image->save(cache.c_str());
+  }
+  setRom(image);
+  return true;
+}
+
+bool Machine::loadRomPath(const char *path) {
+  std::string p(path);
+  if (p.size() > 4 && p.compare(p.size() - 4, 4, ".zip") == 0) {
+    return loadRomZip(path);
+  }
+  return loadRomDir(path);
+}
+
+template <typename F, bool UseHle, bool UseFusion>
+bool Machine::runToInterrupt() {
+  uint32_t start = cpu.cycles;
+  const uint32_t stall = start + halfFrameCycles * 64;
+  // In locals: stores to RAM could alias the members as far as the compiler
+  // knows, and they would be reloaded on every instruction
+  const Fusion *fu = fusion.get();
+  const uint16_t romEnd = cpu.romEnd;
+  uint64_t done = 0;
+  bool ok = true;
+  // Same condition the frontend loop always used: the interrupt is only
+  // taken once the CPU has them enabled
+  while (!(cpu.interrupts && cpu.cycles >= halfFrameCycles)) {
+    // Work done in one go must end before either check below could fire
+    uint32_t limit = cpu.interrupts ? std::min(stall, halfFrameCycles) : stall;
+    if constexpr (UseHle) {
+      const HleRoutine *r = hle->at(cpu.pc);
+      uint32_t before = cpu.cycles;
+      uint32_t n = r != nullptr ? r->run(cpu, limit) : 0;
+      if (n != 0) {
+        hleCalls++;
+        hleCycles += cpu.cycles - before;
+        done += uint64_t(n) * r->instructions;
+        continue;
+      }
+    }
+    if constexpr (UseFusion) {
+      // Only the ROM is known not to change
+      const FusionRule *r = cpu.pc < romEnd ? fu->at(cpu.pc) : nullptr;
+      if (r != nullptr && cpu.cycles + r->maxCycles <= limit) {
+        (cpu.*r->run)();
+        fusionHits[r->index]++;
+        done += r->ops.size();
+        continue;
+      }
+    }
+    cpu.step<F>();
+    done++;
+    if (cpu.cycles - start > halfFrameCycles * 64) {
+      ok = false;
+      break;
+    }
+  }
+  instructions += done;
+  return ok;
+}
+
+bool Machine::stepHalfFrame() {
+  // The core is picked once per half frame rather than per instruction
+  bool ok;
+  if (cpu.hooks != nullptr) {
+    ok = runToInterrupt<DebugFeatures, false, false>();
+  } else if (hle != nullptr && fusion != nullptr) {
+    ok = runToInterrupt<ProductionFeatures, true, true>();
+  } else if (hle != nullptr) {
+    ok = runToInterrupt<ProductionFeatures, true, false>();
+  } else if (fusion != nullptr) {
+    ok = runToInterrupt<ProductionFeatures, false, true>();
+  } else {
+    ok = runToInterrupt<ProductionFeatures, false, false>();
+  }
+  if (!ok) {
+    return false;
+  }
+  deliverInterrupt();
+  return true;
+}
+
+void Machine::step() {
+  cpu.emulateCycle();
+  instructions++;
+  if (cpu.interrupts && cpu.cycles >= halfFrameCycles) {
+    deliverInterrupt();
+  }
+}
+
+void Machine::deliverInterrupt() {
+  // $cf (RST 1) and $d7 (RST 2) alternate
+  cpu.interrupt(interruptSwitch ? 0x10 : 0x08);
+  interruptSwitch = !interruptSwitch;
+  cpu.interrupts = false;
+  interruptsDelivered++;
+
+  if (cpu.sound != nullptr) {
+    cpu.sound->endHalfFrame(cpu.cycles);
+  }
+
+  totalCycles += cpu.cycles;
+  cpu.cycles = 0;
+}
+
+bool Machine::stepFrame() {
+  bool ok = stepHalfFrame() && stepHalfFrame();
+  // A stalled frame didn't finish
+  if (ok) {
+    frames++;
+  }
+  return ok;
+}
+
+uint64_t Machine::stateHash() {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  fnv(h, cpu.pc & 0xff);
+  fnv(h, cpu.pc >> 8);
+  fnv(h, cpu.sp & 0xff);
+  fnv(h, cpu.sp >> 8);
+  for (uint8_t r : {cpu.A, cpu.B, cpu.C, cpu.D, cpu.E, cpu.H, cpu.L}) {
+    fnv(h, r);
+  }
+  fnv(h, cpu.f.psw());
+  fnv(h, static_cast<uint8_t>(cpu.interrupts));
+  fnv(h, static_cast<uint8_t>(interruptSwitch));
+  fnv(h, cpu.shifter.amount);
+  fnv(h, cpu.shifter.value & 0xff);
+  fnv(h, cpu.shifter.value >> 8);
+  for (uint8_t b : cpu.ram) {
+    fnv(h, b);
+  }
+  return h;
+}
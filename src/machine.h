@@ -0,0 +1,92 @@
+#ifndef machine_h
+#define machine_h
+#include "./emu.h"
+#include "./fusion.h"
+#include "./rom.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+struct Hle;
+
+/* A complete Space Invaders board: the CPU, its memory and the interrupt
+ * schedule. Every Machine is independent so several of them can run on
+ * different threads at the same time. Copies share the read-only ROM image
+ * and only duplicate the 8 KB of RAM.
+ */
+struct Machine {
+  // 2 MHz CPU, 60 Hz screen, two interrupts per frame
+  static constexpr uint32_t halfFrameCycles = (2000000 / 60) / 2;
+
+  intel8080 cpu;
+  // Keeps cpu.rom alive
+  std::shared_ptr<const RomImage> rom;
+  // Hot ROM loops to run natively, from Hle::forRom(*rom). Not used by the
+  // debug core, and dropped by setRom.
+  std::shared_ptr<const Hle> hle;
+  uint64_t hleCalls = 0;
+  // Cycles of the above, run natively rather than interpreted
+  uint64_t hleCycles = 0;
+  // Superinstructions, from Fusion::forRom(*rom). Like hle, not used by the
+  // debug core and dropped by setRom; hle goes first where both apply.
+  std::shared_ptr<const Fusion> fusion;
+  // Times each rule ran, by FusionRule::index
+  std::array<uint64_t, fusionRuleCount> fusionHits{};
+
+  // Which interrupt comes next: RST 1 (mid screen) or RST 2 (vblank)
+  bool interruptSwitch = false;
+
+  // Frames completed: stepFrame doesn't count one that stalled
+  uint64_t frames = 0;
+  uint64_t totalCycles = 0;
+
+  // Host side statistics (perf.h). Not part of the emulated state: reset()
+  // leaves them and snapshots don't hold them. Counted by stepHalfFrame
+  // and step; instructions done natively by hle count as the ones they
+  // stand for.
+  uint64_t instructions = 0;
+  uint64_t interruptsDelivered = 0;
+
+  Machine();
+
+  // Clear registers and RAM, keep the ROM
+  void reset();
+
+  // Load invaders.h/g/f/e from a zip file or from a directory
+  bool loadRomZip(const char *zipFile);
+  bool loadRomDir(const char *dir);
+  // Either of the above, depending on whether path ends in .zip
+  bool loadRomPath(const char *path);
+
+  // Run until the next interrupt is delivered. Returns false if the CPU
+  // kept interrupts disabled for far longer than a frame.
+  bool stepHalfFrame();
+  // Two half frames (one 60 Hz video frame)
+  bool stepFrame();
+  // One instruction, then the interrupt if it is due. For debuggers: the
+  // half frame loop is faster.
+  void step();
+  // The end of a half frame: the interrupt, then the cycle count starts
+  // over. For cores that run the half frame themselves.
+  void deliverInterrupt();
+
+  void setInputs(uint8_t read0, uint8_t read1) {
+    cpu.Read0 = read0;
+    cpu.Read1 = read1;
+  }
+
+  // Use an already loaded image
+  void setRom(std::shared_ptr<const RomImage> image);
+
+  // Video RAM, 0x2400-0x3fff
+  const uint8_t *vram() const { return cpu.ram.data() + 0x400; }
+
+  // FNV-1a hash of the registers, flags, shifter and RAM
+  uint64_t stateHash();
+
+private:
+  template <typename F, bool UseHle, bool UseFusion> bool runToInterrupt();
+};
+
+#endif /* machine_h */
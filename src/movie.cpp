@@ -0,0 +1,75 @@
+#include "./movie.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+const char magic[4] = {'S', 'I', 'M', 'V'};
+const uint16_t version = 1;
+
+template <typename T> bool readLE(FILE *f, T *v) {
+  uint8_t buf[sizeof(T)];
+  if (fread(buf, 1, sizeof(T), f) != sizeof(T)) {
+    return false;
+  }
+  *v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    *v |= static_cast<T>(buf[i]) << (8 * i);
+  }
+  return true;
+}
+
+template <typename T> bool writeLE(FILE *f, T v) {
+  uint8_t buf[sizeof(T)];
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buf[i] = (v >> (8 * i)) & 0xff;
+  }
+  return fwrite(buf, 1, sizeof(T), f) == sizeof(T);
+}
+} // namespace
+
+bool Movie::load(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  char m[4];
+  uint16_t ver = 0, reserved = 0;
+  uint32_t frames = 0;
+  bool ok = fread(m, 1, 4, f) == 4 && memcmp(m, magic, 4) == 0 &&
+            readLE(f, &ver) && ver == version && readLE(f, &reserved) &&
+            readLE(f, &frames) && readLE(f, &finalHash);
+
+  // Two bytes a frame must follow, or a corrupt count could ask for
+  // gigabytes
+  if (ok) {
+    long at = ftell(f);
+    ok = at >= 0 && fseek(f, 0, SEEK_END) == 0;
+    long end = ok ? ftell(f) : -1;
+    ok = ok && end >= at && uint64_t(frames) * 2 <= uint64_t(end - at) &&
+         fseek(f, at, SEEK_SET) == 0;
+  }
+  if (ok) {
+    inputs.resize(frames);
+    ok = fread(inputs.data(), 2, frames, f) == frames;
+  }
+  fclose(f);
+
+  name = path.substr(path.find_last_of('/') + 1);
+  return ok;
+}
+
+bool Movie::save(const std::string &path) const {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  auto frames = static_cast<uint32_t>(inputs.size());
+  bool ok = fwrite(magic, 1, 4, f) == 4 && writeLE(f, version) &&
+            writeLE<uint16_t>(f, 0) && writeLE(f, frames) &&
+            writeLE(f, finalHash) &&
+            fwrite(inputs.data(), 2, frames, f) == frames;
+  return fclose(f) == 0 && ok;
+}
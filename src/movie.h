@@ -0,0 +1,26 @@
+#ifndef movie_h
+#define movie_h
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Recorded input movie: the values of input ports 1 and 2 for every
+ * frame, plus the state hash the machine had after the last frame.
+ *
+ * File layout (little endian):
+ *   "SIMV" | u16 version | u16 reserved | u32 frames | u64 final hash
+ *   frames * { u8 Read0, u8 Read1 }
+ * A final hash of 0 means none was recorded.
+ */
+struct Movie {
+  std::string name;
+  std::vector<std::array<uint8_t, 2>> inputs;
+  uint64_t finalHash = 0;
+
+  bool load(const std::string &path);
+  bool save(const std::string &path) const;
+};
+
+#endif /* movie_h */
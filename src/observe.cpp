@@ -0,0 +1,109 @@
+#include "./observe.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr int columnBytes = observe::vramBytesPerColumn;
+
+// Byte -> 8 / downsample output pixels
+template <int Downsample> struct Lut {
+  static constexpr int outPerByte = 8 / Downsample;
+  std::array<std::array<uint8_t, outPerByte>, 256> table;
+
+  Lut() {
+    for (int b = 0; b < 256; ++b) {
+      for (int i = 0; i < outPerByte; ++i) {
+        int block = (b >> (i * Downsample)) & ((1 << Downsample) - 1);
+        table[b][i] = block != 0 ? 0xff : 0x00;
+      }
+    }
+  }
+};
+
+// OR together Downsample consecutive VRAM columns
+template <int Downsample>
+void mergeColumns(const uint8_t *vram, uint8_t *merged) {
+#if defined(__SSE2__)
+  __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(vram));
+  __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(vram + 16));
+  for (int c = 1; c < Downsample; ++c) {
+    const uint8_t *col = vram + c * columnBytes;
+    lo = _mm_or_si128(lo, _mm_loadu_si128(reinterpret_cast<const __m128i *>(col)));
+    hi = _mm_or_si128(hi, _mm_loadu_si128(reinterpret_cast<const __m128i *>(col + 16)));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(merged), lo);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(merged + 16), hi);
+#else
+  memcpy(merged, vram, columnBytes);
+  for (int c = 1; c < Downsample; ++c) {
+    for (int i = 0; i < columnBytes; ++i) {
+      merged[i] |= vram[c * columnBytes + i];
+    }
+  }
+#endif
+}
+
+template <int Downsample> void unpackDownsampled(const uint8_t *vram, uint8_t *out) {
+  static const Lut<Downsample> lut;
+  constexpr int outPerByte = Lut<Downsample>::outPerByte;
+
+  uint8_t merged[columnBytes];
+  for (int x = 0; x < observe::vramColumns; x += Downsample) {
+    mergeColumns<Downsample>(vram + x * columnBytes, merged);
+    for (int i = 0; i < columnBytes; ++i) {
+      memcpy(out, lut.table[merged[i]].data(), outPerByte);
+      out += outPerByte;
+    }
+  }
+}
+
+void unpackFull(const uint8_t *vram, uint8_t *out) {
+  constexpr int bytes = observe::vramColumns * columnBytes;
+#if defined(__SSE2__)
+  // Broadcast every input byte to 8 lanes with unpacks, then test one bit
+  // per lane: 16 input bytes become 128 output bytes
+  const __m128i mask = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64,
+                                    32, 16, 8, 4, 2, 1);
+  for (int i = 0; i < bytes; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(vram + i));
+    __m128i b8[2] = {_mm_unpacklo_epi8(v, v), _mm_unpackhi_epi8(v, v)};
+    for (const __m128i &x : b8) {
+      __m128i b16[2] = {_mm_unpacklo_epi16(x, x), _mm_unpackhi_epi16(x, x)};
+      for (const __m128i &y : b16) {
+        __m128i b32[2] = {_mm_unpacklo_epi32(y, y), _mm_unpackhi_epi32(y, y)};
+        for (const __m128i &z : b32) {
+          __m128i bits = _mm_cmpeq_epi8(_mm_and_si128(z, mask), mask);
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bits);
+          out += 16;
+        }
+      }
+    }
+  }
+#else
+  for (int i = 0; i < bytes; ++i) {
+    for (int bit = 0; bit < 8; ++bit) {
+      *out++ = (vram[i] >> bit) & 1 ? 0xff : 0x00;
+    }
+  }
+#endif
+}
+} // namespace
+
+void observe::unpack(const uint8_t *vram, int downsample, uint8_t *out) {
+  switch (downsample) {
+  case 2:
+    unpackDownsampled<2>(vram, out);
+    break;
+  case 4:
+    unpackDownsampled<4>(vram, out);
+    break;
+  default:
+    unpackFull(vram, out);
+    break;
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef observe_h
+#define observe_h
+
+#include <cstddef>
+#include <cstdint>
+
+/* Converts the 1bpp video RAM (0x2400-0x3fff) straight into 8 bit
+ * observations, without going through Display::pixels.
+ *
+ * The output keeps the VRAM orientation: one row per screen column
+ * (224 rows) and one byte per pixel going up the screen (256 pixels).
+ * With a downsample factor of 2 or 4 each output byte covers a square
+ * block of pixels and is lit if any pixel of the block is lit.
+ * Lit pixels are 0xff, dark pixels 0x00.
+ */
+namespace observe {
+constexpr int vramColumns = 224;
+constexpr int vramBytesPerColumn = 32;
+
+constexpr int rows(int downsample) { return vramColumns / downsample; }
+constexpr int cols(int downsample) { return 8 * vramBytesPerColumn / downsample; }
+constexpr size_t size(int downsample) {
+  return static_cast<size_t>(rows(downsample)) * cols(downsample);
+}
+
+// downsample must be 1, 2 or 4. out must hold size(downsample) bytes.
+void unpack(const uint8_t *vram, int downsample, uint8_t *out);
+} // namespace observe
+
+#endif /* observe_h */
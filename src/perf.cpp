@@ -0,0 +1,186 @@
+#include "./perf.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// 0-3 have a bucket each; above, four buckets per power of two, picked by
+// the two bits under the top one
+int bucketOf(uint64_t ns) {
+  if (ns < 4) {
+    return static_cast<int>(ns);
+  }
+  int log = 63 - __builtin_clzll(ns);
+  int b = (log - 1) * 4 + static_cast<int>((ns >> (log - 2)) & 3);
+  return std::min(b, TimeHistogram::bucketCount - 1);
+}
+
+uint64_t bucketLow(int b) {
+  if (b < 4) {
+    return b;
+  }
+  int log = b / 4 + 1;
+  return uint64_t(4 + b % 4) << (log - 2);
+}
+
+double us(uint64_t ns) { return ns / 1000.0; }
+
+unsigned long long ull(uint64_t v) {
+  return static_cast<unsigned long long>(v);
+}
+
+void writeCounters(FILE *f, const PerfMonitor::Counters &c) {
+  fprintf(f,
+          "{\"instructions\":%llu,\"cycles\":%llu,\"interrupts\":%llu,"
+          "\"frames\":%llu,\"hle_cycles\":%llu}",
+          ull(c.instructions), ull(c.cycles), ull(c.interrupts),
+          ull(c.frames), ull(c.hleCycles));
+}
+} // namespace
+
+void TimeHistogram::add(uint64_t ns) {
+  buckets[bucketOf(ns)]++;
+  count++;
+  totalNs += ns;
+  maxNs = std::max(maxNs, ns);
+}
+
+void TimeHistogram::merge(const TimeHistogram &other) {
+  for (int b = 0; b < bucketCount; ++b) {
+    buckets[b] += other.buckets[b];
+  }
+  count += other.count;
+  totalNs += other.totalNs;
+  maxNs = std::max(maxNs, other.maxNs);
+}
+
+uint64_t TimeHistogram::quantileNs(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  // The sample of rank ceil(q * count), counting from 1
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(q * count + 0.999999));
+  uint64_t seen = 0;
+  for (int b = 0; b < bucketCount; ++b) {
+    seen += buckets[b];
+    if (seen >= rank) {
+      uint64_t high = b + 1 < bucketCount ? bucketLow(b + 1) - 1 : maxNs;
+      return std::min(high, maxNs);
+    }
+  }
+  return maxNs;
+}
+
+const char *PerfMonitor::stageName(int stage) {
+  static const char *names[stageCount] = {"emulation", "conversion",
+                                          "present", "input", "loop"};
+  return stage >= 0 && stage < stageCount ? names[stage] : "?";
+}
+
+PerfMonitor::Counters PerfMonitor::Counters::of(const Machine &m) {
+  Counters c;
+  c.instructions = m.instructions;
+  // Including the half frame in progress
+  c.cycles = m.totalCycles + m.cpu.cycles;
+  c.interrupts = m.interruptsDelivered;
+  c.frames = m.frames;
+  c.hleCycles = m.hleCycles;
+  return c;
+}
+
+PerfMonitor::Counters
+PerfMonitor::Counters::operator-(const Counters &since) const {
+  Counters c;
+  c.instructions = instructions - since.instructions;
+  c.cycles = cycles - since.cycles;
+  c.interrupts = interrupts - since.interrupts;
+  c.frames = frames - since.frames;
+  c.hleCycles = hleCycles - since.hleCycles;
+  return c;
+}
+
+PerfMonitor::PerfMonitor()
+    : windowStartTime(Clock::now()), opened(windowStartTime) {}
+
+PerfMonitor::~PerfMonitor() { close(); }
+
+bool PerfMonitor::open(const char *path, double interval) {
+  close();
+  out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  this->interval = interval > 0 ? interval : 1;
+  opened = windowStartTime = Clock::now();
+  return out != nullptr;
+}
+
+void PerfMonitor::close() {
+  if (out != nullptr && out != stdout) {
+    fclose(out);
+  }
+  out = nullptr;
+}
+
+bool PerfMonitor::tick(const Machine &m) {
+  if (out == nullptr) {
+    return false;
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - windowStartTime;
+  if (elapsed.count() < interval) {
+    return false;
+  }
+  report(m);
+  return true;
+}
+
+void PerfMonitor::report(const Machine &m) {
+  if (out != nullptr) {
+    writeJson(out, m);
+    fflush(out);
+  }
+  for (TimeHistogram &h : window) {
+    h.clear();
+  }
+  windowStart = Counters::of(m);
+  windowStartTime = Clock::now();
+  if (frameSkip != nullptr) {
+    presentedStart = frameSkip->presented;
+    skippedStart = frameSkip->skipped;
+  }
+}
+
+void PerfMonitor::writeJson(FILE *f, const Machine &m) const {
+  auto now = Clock::now();
+  double time = std::chrono::duration<double>(now - opened).count();
+  double span = std::chrono::duration<double>(now - windowStartTime).count();
+  Counters totals = Counters::of(m);
+  Counters delta = totals - windowStart;
+  // 2 MHz
+  double speed = span > 0 ? delta.cycles / 2e6 / span : 0;
+
+  fprintf(f, "{\"time\":%.3f,\"window\":%.3f,\"speed\":%.3f,\"counters\":",
+          time, span, speed);
+  writeCounters(f, delta);
+  fprintf(f, ",\"totals\":");
+  writeCounters(f, totals);
+  fprintf(f, ",\"stages\":{");
+  for (int s = 0; s < stageCount; ++s) {
+    const TimeHistogram &h = window[s];
+    fprintf(f,
+            "%s\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.1f,"
+            "\"p99_us\":%.1f,\"max_us\":%.1f}",
+            s == 0 ? "" : ",", stageName(s), ull(h.count), us(h.meanNs()),
+            us(h.quantileNs(0.5)), us(h.quantileNs(0.99)), us(h.maxNs));
+  }
+  fprintf(f, "}");
+  if (frameSkip != nullptr) {
+    uint64_t presented = frameSkip->presented - presentedStart;
+    uint64_t skipped = frameSkip->skipped - skippedStart;
+    uint64_t passes = presented + skipped;
+    fprintf(f,
+            ",\"frameskip\":{\"level\":%d,\"presented\":%llu,"
+            "\"skipped\":%llu,\"ratio\":%.3f,\"total_ratio\":%.3f}",
+            frameSkip->level(), ull(presented), ull(skipped),
+            passes != 0 ? double(skipped) / passes : 0.0,
+            frameSkip->skipRatio());
+  }
+  fprintf(f, "}\n");
+}
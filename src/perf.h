@@ -0,0 +1,135 @@
+#ifndef perf_h
+#define perf_h
+#include "./frameskip.h"
+#include "./machine.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/* Host durations in nanoseconds, in buckets a quarter of a power of two
+ * wide: each bucket's upper bound is at most 25% above its lower one,
+ * whatever the scale, and adding a sample is a few instructions.
+ */
+struct TimeHistogram {
+  static constexpr int bucketCount = 160;
+
+  std::array<uint64_t, bucketCount> buckets{};
+  uint64_t count = 0;
+  uint64_t totalNs = 0;
+  uint64_t maxNs = 0;
+
+  void add(uint64_t ns);
+  void merge(const TimeHistogram &other);
+  void clear() { *this = TimeHistogram(); }
+
+  double meanNs() const { return count != 0 ? double(totalNs) / count : 0; }
+  // Upper bound of the bucket holding the q quantile (0-1), capped by the
+  // largest sample
+  uint64_t quantileNs(double q) const;
+};
+
+/* Where the frontend's time goes. The emulated counters come from the
+ * Machine; the host times are histograms per stage of the frontend loop,
+ * fed by Timer. total covers the whole run and window the time since the
+ * last report(), which writes one JSON line:
+ *
+ *   {"time":2.001,"window":1.000,"speed":1.00,
+ *    "counters":{"instructions":...,"cycles":...,"interrupts":120,
+ *                "frames":60,"hle_cycles":...},
+ *    "totals":{...same, since power-on...},
+ *    "stages":{"emulation":{"count":60,"mean_us":...,"p50_us":...,
+ *              "p99_us":...,"max_us":...},...}}
+ *
+ * Counters in "counters" are over the window. speed is emulated time over
+ * host time, 1 at full speed. present includes the wait for vsync when
+ * the swap is synchronised. With frameSkip set the line also has
+ *
+ *   "frameskip":{"level":1,"presented":60,"skipped":60,"ratio":0.50,
+ *                "total_ratio":0.48}
+ *
+ * presented and skipped count the passes of the window; ratio is skipped
+ * over all passes in the window, total_ratio since the start.
+ */
+struct PerfMonitor {
+  enum Stage {
+    Emulation,  // Machine::stepFrame
+    Conversion, // video RAM to display pixels
+    Present,    // texture upload and swap
+    Input,      // polling window events
+    Loop,       // one whole pass of the frontend loop
+    stageCount
+  };
+  static const char *stageName(int stage);
+
+  struct Counters {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t interrupts = 0;
+    uint64_t frames = 0;
+    uint64_t hleCycles = 0;
+
+    static Counters of(const Machine &m);
+    Counters operator-(const Counters &since) const;
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  // Records the time from construction to destruction under a stage
+  class Timer {
+  public:
+    Timer(PerfMonitor &perf, Stage stage)
+        : perf(perf), stage(stage), start(Clock::now()) {}
+    ~Timer() {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start);
+      perf.record(stage, ns.count());
+    }
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+  private:
+    PerfMonitor &perf;
+    Stage stage;
+    Clock::time_point start;
+  };
+
+  std::array<TimeHistogram, stageCount> total, window;
+
+  PerfMonitor();
+  ~PerfMonitor();
+
+  void record(Stage stage, uint64_t ns) {
+    total[stage].add(ns);
+    window[stage].add(ns);
+  }
+
+  // Report to path ("-" for stdout) every interval seconds. Without it
+  // report() does nothing, and the histograms still fill.
+  bool open(const char *path, double interval = 1);
+  void close();
+  bool reporting() const { return out != nullptr; }
+
+  // Once per pass of the loop: writes a line and starts a new window once
+  // interval has gone by. Returns true when it did.
+  bool tick(const Machine &m);
+  // Writes the line and starts a new window now
+  void report(const Machine &m);
+  void writeJson(FILE *f, const Machine &m) const;
+
+  // Reported on when set
+  const FrameSkip *frameSkip = nullptr;
+
+  // Counters and time at the start of the window
+  Counters windowStart;
+  Clock::time_point windowStartTime;
+  uint64_t presentedStart = 0, skippedStart = 0;
+
+private:
+  FILE *out = nullptr;
+  double interval = 1;
+  Clock::time_point opened;
+};
+
+#endif /* perf_h */
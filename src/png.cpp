@@ -0,0 +1,81 @@
+#include "./png.h"
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+namespace {
+const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+void putBE(std::vector<uint8_t> &out, uint32_t v) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back((v >> shift) & 0xff);
+  }
+}
+
+// Length, type, data, CRC of type and data
+void chunk(std::vector<uint8_t> &out, const char type[4], const uint8_t *data,
+           size_t n) {
+  putBE(out, static_cast<uint32_t>(n));
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + n);
+  uLong crc = crc32(0, out.data() + start, static_cast<uInt>(n + 4));
+  putBE(out, static_cast<uint32_t>(crc));
+}
+} // namespace
+
+bool png::encode(const uint8_t *rgba, int width, int height, int level,
+                 std::vector<uint8_t> &out) {
+  // Every row starts with its filter: none. The screen is a few flat
+  // colours, which deflate handles as well unfiltered.
+  const size_t stride = size_t(width) * 4;
+  std::vector<uint8_t> raw((stride + 1) * height);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *row = &raw[y * (stride + 1)];
+    row[0] = 0;
+    std::copy(rgba + y * stride, rgba + (y + 1) * stride, row + 1);
+  }
+
+  uLongf packedSize = compressBound(raw.size());
+  std::vector<uint8_t> packed(packedSize);
+  if (compress2(packed.data(), &packedSize, raw.data(), raw.size(), level) !=
+      Z_OK) {
+    return false;
+  }
+
+  std::vector<uint8_t> header;
+  putBE(header, width);
+  putBE(header, height);
+  // 8 bits, RGBA, deflate, adaptive filtering, no interlace
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+
+  out.assign(signature, signature + sizeof(signature));
+  chunk(out, "IHDR", header.data(), header.size());
+  chunk(out, "IDAT", packed.data(), packedSize);
+  chunk(out, "IEND", nullptr, 0);
+  return true;
+}
+
+bool png::save(const char *path, const std::vector<uint8_t> &data) {
+  // Unique to the call as well as the process, so threads saving the same
+  // path never share a temporary file
+  static std::atomic<uint64_t> saves{0};
+  std::string tmp = std::string(path) + "." + std::to_string(getpid()) + "." +
+                    std::to_string(saves++);
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
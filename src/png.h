@@ -0,0 +1,18 @@
+#ifndef png_h
+#define png_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace png {
+// Encodes width x height RGBA pixels (rows top to bottom) as a PNG file
+// in out, deflated with zlib at level (0-9). False if zlib fails.
+bool encode(const uint8_t *rgba, int width, int height, int level,
+            std::vector<uint8_t> &out);
+
+// Writes data to path through a temporary file renamed to it
+bool save(const char *path, const std::vector<uint8_t> &data);
+} // namespace png
+
+#endif /* png_h */
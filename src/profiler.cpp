@@ -0,0 +1,147 @@
+#include "./profiler.h"
+#include "./disasm.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+// "JMP a16", "MVI B,d8"
+std::string mnemonic(uint8_t op) {
+  std::string s = disasm::opcode(op).format;
+  size_t at = s.find('%');
+  if (at != std::string::npos) {
+    bool word = disasm::opcode(op).length == 3;
+    s = s.substr(0, at - (word ? 1 : 2)) + (word ? "a16" : "d8");
+  }
+  return s;
+}
+
+template <typename T, size_t N>
+std::vector<size_t> topIndices(const std::array<T, N> &values, size_t top) {
+  std::vector<size_t> idx;
+  for (size_t i = 0; i < N; ++i) {
+    if (values[i] != 0) {
+      idx.push_back(i);
+    }
+  }
+  top = std::min(top, idx.size());
+  std::partial_sort(idx.begin(), idx.begin() + top, idx.end(),
+                    [&](size_t a, size_t b) { return values[a] > values[b]; });
+  idx.resize(top);
+  return idx;
+}
+} // namespace
+
+Profiler::Profiler() { reset(); }
+
+void Profiler::reset() {
+  pcCount.fill(0);
+  pcCycles.fill(0);
+  opCount.fill(0);
+  opCycles.fill(0);
+  instructions = 0;
+  cycles = 0;
+  nodes.assign(1, Node{0, 0, false, 0});
+  children.clear();
+  stack.clear();
+  started = false;
+}
+
+void Profiler::enter(uint16_t entry, uint16_t frameSp, bool interrupt) {
+  uint32_t parent = current();
+  uint64_t key = (static_cast<uint64_t>(parent) << 17) |
+                 (static_cast<uint64_t>(interrupt) << 16) | entry;
+  auto it = children.find(key);
+  uint32_t node;
+  if (it != children.end()) {
+    node = it->second;
+  } else {
+    node = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(Node{parent, entry, interrupt, 0});
+    children.emplace(key, node);
+  }
+  stack.push_back(Frame{node, frameSp});
+}
+
+void Profiler::before(const intel8080 &cpu) {
+  // Interrupts are delivered between instructions: the cpu is somewhere
+  // else than the last one left it, with a return address pushed
+  if (started && cpu.pc != nextPc &&
+      cpu.sp == static_cast<uint16_t>(nextSp - 2)) {
+    enter(cpu.pc, cpu.sp, true);
+  }
+  // Frames whose return address has been popped or thrown away
+  while (!stack.empty() && cpu.sp > stack.back().sp) {
+    stack.pop_back();
+  }
+
+  pc = cpu.pc;
+  sp = cpu.sp;
+  op = cpu.read(pc);
+  startCycles = cpu.cycles;
+}
+
+void Profiler::after(const intel8080 &cpu) {
+  uint32_t c = cpu.cycles - startCycles;
+  pcCount[pc]++;
+  pcCycles[pc] += c;
+  opCount[op]++;
+  opCycles[op] += c;
+  instructions++;
+  cycles += c;
+  // Calls are charged to the caller
+  nodes[current()].cycles += c;
+
+  if (disasm::isCall(op) && cpu.sp == static_cast<uint16_t>(sp - 2)) {
+    enter(cpu.pc, cpu.sp, false);
+  }
+  started = true;
+  nextPc = cpu.pc;
+  nextSp = cpu.sp;
+}
+
+void Profiler::writeFolded(FILE *f) const {
+  std::vector<std::string> names;
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    if (nodes[n].cycles == 0) {
+      continue;
+    }
+    names.clear();
+    for (uint32_t i = static_cast<uint32_t>(n); i != 0; i = nodes[i].parent) {
+      char name[16];
+      snprintf(name, sizeof(name), "%s_%04x",
+               nodes[i].interrupt ? "int" : "sub", nodes[i].entry);
+      names.push_back(name);
+    }
+    fputs("root", f);
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+      fprintf(f, ";%s", it->c_str());
+    }
+    fprintf(f, " %llu\n", static_cast<unsigned long long>(nodes[n].cycles));
+  }
+}
+
+void Profiler::writeHot(FILE *f, const intel8080 &cpu, size_t top) const {
+  double total = cycles != 0 ? static_cast<double>(cycles) : 1;
+  fprintf(f, "%llu instructions, %llu cycles\n\n",
+          static_cast<unsigned long long>(instructions),
+          static_cast<unsigned long long>(cycles));
+
+  fprintf(f, "  addr        count       cycles      %%  instruction\n");
+  for (size_t pc : topIndices(pcCycles, top)) {
+    fprintf(f, "  %04zx %12llu %12llu %6.2f  %s\n", pc,
+            static_cast<unsigned long long>(pcCount[pc]),
+            static_cast<unsigned long long>(pcCycles[pc]),
+            100 * pcCycles[pc] / total,
+            disasm::format(cpu, static_cast<uint16_t>(pc)).c_str());
+  }
+
+  fprintf(f, "\n  op          count       cycles      %%  mnemonic\n");
+  for (size_t op : topIndices(opCycles, top)) {
+    fprintf(f, "  %02zx   %12llu %12llu %6.2f  %s\n", op,
+            static_cast<unsigned long long>(opCount[op]),
+            static_cast<unsigned long long>(opCycles[op]),
+            100 * opCycles[op] / total,
+            mnemonic(static_cast<uint8_t>(op)).c_str());
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef profiler_h
+#define profiler_h
+#include "./emu.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+/* Instruction level profile of the emulated program: executions and cycles
+ * per pc and per opcode, and cycles per call stack. The call stack is a
+ * shadow of the program's own. It follows CALL, RST and interrupts, and a
+ * frame is dropped as soon as sp moves above its return address, so code
+ * that pops return addresses or reloads sp doesn't confuse it.
+ *
+ * Set it as intel8080::hooks: only the debug core calls it.
+ */
+struct Profiler : CpuHooks {
+  std::array<uint64_t, 65536> pcCount = {};
+  std::array<uint64_t, 65536> pcCycles = {};
+  std::array<uint64_t, 256> opCount = {};
+  std::array<uint64_t, 256> opCycles = {};
+  uint64_t instructions = 0;
+  uint64_t cycles = 0;
+
+  Profiler();
+  void reset();
+
+  // Called by the debug core around every instruction
+  void before(const intel8080 &cpu) override;
+  void after(const intel8080 &cpu) override;
+
+  // One "root;sub_18d4;sub_1a32 <cycles>" line per stack, the folded
+  // format read by flamegraph.pl and speedscope
+  void writeFolded(FILE *f) const;
+  // The top addresses and opcodes by cycles, with their instructions
+  void writeHot(FILE *f, const intel8080 &cpu, size_t top) const;
+
+private:
+  struct Node {
+    uint32_t parent;
+    uint16_t entry;
+    bool interrupt;
+    uint64_t cycles; // spent in this routine itself, not its callees
+  };
+  struct Frame {
+    uint32_t node;
+    uint16_t sp; // where the return address is
+  };
+
+  std::vector<Node> nodes; // call tree, nodes[0] is the root
+  std::unordered_map<uint64_t, uint32_t> children;
+  std::vector<Frame> stack;
+
+  // The instruction in flight
+  uint16_t pc = 0, sp = 0;
+  uint8_t op = 0;
+  uint32_t startCycles = 0;
+  // Where the previous one left the cpu, to spot interrupts
+  bool started = false;
+  uint16_t nextPc = 0, nextSp = 0;
+
+  void enter(uint16_t entry, uint16_t frameSp, bool interrupt);
+  uint32_t current() const { return stack.empty() ? 0 : stack.back().node; }
+};
+
+#endif /* profiler_h */
@@ -0,0 +1,189 @@
+#include "./render.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr int W = SoftRenderer::screenWidth, H = SoftRenderer::screenHeight;
+constexpr int columnBytes = 32;
+
+// Packed RGBA as it lies in memory
+constexpr uint32_t pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+  return r | g << 8 | b << 16 | uint32_t(a) << 24;
+}
+constexpr uint32_t white = pack(0xff, 0xff, 0xff, 0xff);
+constexpr uint32_t red = pack(0xff, 0, 0, 0xff);
+constexpr uint32_t green = pack(0, 0xff, 0, 0xff);
+constexpr uint32_t black = pack(0, 0, 0, 0xff);
+constexpr uint32_t border = pack(0, 0, 0, 0);
+
+// The colour Display::fragmentSource gives texel (x, y) of the 256x224
+// texture (x along the VRAM column, y the column)
+uint32_t overlay(int x, int y) {
+  if (x > (256 - 65) && x < (256 - 32)) {
+    return red;
+  } else if (x > 15 && x < (256 - 184)) {
+    return green;
+  } else if (x < 17 && (y < 122) && (y > 16)) {
+    return green;
+  }
+  return white;
+}
+
+// Screen row r is lit by this bit of this byte of every VRAM column
+int rowByte(int r) { return (H - 1 - r) >> 3; }
+int rowBit(int r) { return (H - 1 - r) & 7; }
+
+// One screen row: tint where lit, black elsewhere
+void tintRow(const uint8_t *bytes, int bit, const uint32_t *tint,
+             uint32_t *out) {
+#if defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi8(static_cast<char>(1 << bit));
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(black));
+  for (int c = 0; c < W; c += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + c));
+    __m128i lit8 = _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+    __m128i lit16[2] = {_mm_unpacklo_epi8(lit8, lit8),
+                        _mm_unpackhi_epi8(lit8, lit8)};
+    for (int h = 0; h < 2; ++h) {
+      __m128i lit32[2] = {_mm_unpacklo_epi16(lit16[h], lit16[h]),
+                          _mm_unpackhi_epi16(lit16[h], lit16[h])};
+      for (int q = 0; q < 2; ++q) {
+        int at = c + h * 8 + q * 4;
+        __m128i t =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(tint + at));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + at),
+                         _mm_or_si128(_mm_and_si128(t, lit32[q]), alpha));
+      }
+    }
+  }
+#else
+  for (int c = 0; c < W; ++c) {
+    out[c] = (bytes[c] >> bit) & 1 ? tint[c] : black;
+  }
+#endif
+}
+
+// Rows an output band must have to be worth a task
+constexpr int bandRows = 64;
+} // namespace
+
+SoftRenderer::SoftRenderer(const Config &config) : config(config) {
+  if (this->config.scale < 1) {
+    this->config.scale = 1;
+  }
+  if (this->config.threads > 1 && size_t(width()) * height() >= 512 * 512) {
+    pool.reset(new ThreadPool(this->config.threads));
+  }
+
+  // Screen pixel (c, r) is texel x = 255 - r, y = c
+  tint.resize(W * H);
+  for (int r = 0; r < H; ++r) {
+    for (int c = 0; c < W; ++c) {
+      tint[r * W + c] = this->config.overlay ? overlay(H - 1 - r, c) : white;
+    }
+  }
+
+  if (this->config.distortion) {
+    // The texture coordinate GL interpolates at each output pixel's
+    // centre, bent by radialDistortion(), in the shader's float precision
+    const int ow = width(), oh = height();
+    source.resize(size_t(ow) * oh);
+    outputTint.resize(source.size());
+    upright.resize(W * H);
+    for (int y = 0; y < oh; ++y) {
+      for (int x = 0; x < ow; ++x) {
+        float tx = 1.0f - (y + 0.5f) / oh, ty = (x + 0.5f) / ow;
+        float cx = tx - 0.5f, cy = ty - 0.5f;
+        float dist = (cx * cx + cy * cy) * 0.2f;
+        float dx = tx + cx * (1.0f - dist) * dist;
+        float dy = ty + cy * (1.0f - dist) * dist;
+        int texX = static_cast<int>(std::floor(dx * 256));
+        int texY = static_cast<int>(std::floor(dy * 224));
+        size_t i = size_t(y) * ow + x;
+        source[i] = texX >= 0 && texX < 256 && texY >= 0 && texY < 224
+                        ? (H - 1 - texX) * W + texY
+                        : -1;
+        // The bands follow the undistorted coordinate
+        int bandX = static_cast<int>(std::floor(tx * 256));
+        int bandY = static_cast<int>(std::floor(ty * 224));
+        outputTint[i] = this->config.overlay ? overlay(bandX, bandY) : white;
+      }
+    }
+  }
+}
+
+void SoftRenderer::render(const uint8_t *vram, uint8_t *rgba) {
+  auto *out = reinterpret_cast<uint32_t *>(rgba);
+  if (config.distortion) {
+    // The upright screen, one byte per pixel, then the table lookups
+    for (int r = 0; r < H; ++r) {
+      int byte = rowByte(r), bit = rowBit(r);
+      for (int c = 0; c < W; ++c) {
+        upright[r * W + c] = (vram[c * columnBytes + byte] >> bit) & 1;
+      }
+    }
+  }
+
+  // Screen rows for direct rendering, output rows with distortion
+  const int rows = config.distortion ? height() : H;
+  const int perBand = config.distortion ? bandRows : bandRows / config.scale;
+  const int bands = pool ? (rows + std::max(perBand, 1) - 1) /
+                               std::max(perBand, 1)
+                         : 1;
+  auto band = [&](size_t b, size_t) {
+    int from = int(b) * rows / bands, to = int(b + 1) * rows / bands;
+    if (config.distortion) {
+      distortRows(out, from, to);
+    } else {
+      renderRows(vram, out, from, to);
+    }
+  };
+  if (bands > 1) {
+    pool->parallelFor(bands, band);
+  } else {
+    band(0, 0);
+  }
+}
+
+// Screen rows [from, to), each scale output rows of scale copies a pixel
+void SoftRenderer::renderRows(const uint8_t *vram, uint32_t *out, int from,
+                              int to) {
+  const int s = config.scale, ow = width();
+  uint8_t bytes[W];
+  uint32_t row[W];
+  for (int r = from; r < to; ++r) {
+    // Row r lights the same bit of the same byte of every column
+    int byte = rowByte(r);
+    for (int c = 0; c < W; ++c) {
+      bytes[c] = vram[c * columnBytes + byte];
+    }
+
+    uint32_t *line = out + size_t(r) * s * ow;
+    if (s == 1) {
+      tintRow(bytes, rowBit(r), &tint[r * W], line);
+      continue;
+    }
+    tintRow(bytes, rowBit(r), &tint[r * W], row);
+    for (int c = 0; c < W; ++c) {
+      std::fill(line + c * s, line + (c + 1) * s, row[c]);
+    }
+    for (int k = 1; k < s; ++k) {
+      memcpy(line + size_t(k) * ow, line, ow * sizeof(uint32_t));
+    }
+  }
+}
+
+// Output rows [from, to) through the distortion table
+void SoftRenderer::distortRows(uint32_t *out, int from, int to) const {
+  const size_t ow = width();
+  for (size_t i = from * ow; i < to * ow; ++i) {
+    int32_t at = source[i];
+    out[i] = at < 0 ? border : upright[at] ? outputTint[i] : black;
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef render_h
+#define render_h
+#include "./threadpool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* Draws the video RAM the way the frontend's GL path does (display.h), on
+ * the CPU and without a GL context: turned upright (224x256), tinted by
+ * the overlay bands of Display::fragmentSource, scaled by a whole number
+ * and written as RGBA, rows top to bottom. Lit pixels take the band's
+ * colour, dark ones are opaque black.
+ *
+ * The fragment shader defines radialDistortion() but doesn't call it, so
+ * distortion is off by default; with it on, every output pixel samples the
+ * distorted texture coordinate, as the shader would with
+ * texture(tex, radialDistortion(Texcoord)), and pixels that fall outside
+ * the texture take the border colour (transparent black).
+ *
+ * The overlay colours and the distortion are tables built once; a frame
+ * is a gather, a mask and a store per pixel (SSE2 where there is one).
+ * Outputs of at least 512x512 pixels are split into bands of rows over a
+ * thread pool when threads > 1.
+ */
+struct SoftRenderer {
+  static constexpr int screenWidth = 224, screenHeight = 256;
+
+  struct Config {
+    int scale = 1;
+    bool overlay = true;
+    bool distortion = false;
+    size_t threads = 1;
+  };
+
+  explicit SoftRenderer(const Config &config);
+
+  int width() const { return screenWidth * config.scale; }
+  int height() const { return screenHeight * config.scale; }
+  size_t size() const { return size_t(width()) * height() * 4; }
+
+  // vram is 0x2400-0x3fff; rgba holds size() bytes
+  void render(const uint8_t *vram, uint8_t *rgba);
+
+private:
+  Config config;
+  std::unique_ptr<ThreadPool> pool;
+  // RGBA of a lit pixel, upright, at screen size
+  std::vector<uint32_t> tint;
+  // With distortion: the screen pixel every output pixel shows (-1 for
+  // the border) and its tint, at output size
+  std::vector<int32_t> source;
+  std::vector<uint32_t> outputTint;
+  std::vector<uint8_t> upright; // lit screen pixels, for distortion
+
+  void renderRows(const uint8_t *vram, uint32_t *out, int from, int to);
+  void distortRows(uint32_t *out, int from, int to) const;
+};
+
+#endif /* render_h */
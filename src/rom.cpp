@@ -0,0 +1,130 @@
+#include "./rom.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+// MAME's invaders set
+const RomSet romSets[] = {
+    {"invaders", {{0x734f5ad8, 0x6bfaca4a, 0x0ccead96, 0x14e538b0}}},
+};
+
+const std::array<uint32_t, 256> crcTable = [] {
+  std::array<uint32_t, 256> table = {};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) {
+      c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    table[i] = c;
+  }
+  return table;
+}();
+} // namespace
+
+std::shared_ptr<RomImage> RomImage::create() {
+  std::shared_ptr<RomImage> rom(new RomImage);
+
+  // Whole pages, so sealing doesn't protect anything else
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  rom->mapped = (size + page - 1) / page * page;
+  void *p = mmap(nullptr, rom->mapped, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    abort();
+  }
+  rom->bytes = static_cast<uint8_t *>(p);
+  return rom;
+}
+
+std::shared_ptr<const RomImage> RomImage::blank() {
+  static std::shared_ptr<const RomImage> image = [] {
+    auto rom = create();
+    rom->seal();
+    return rom;
+  }();
+  return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::map(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st = {};
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size) {
+    p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::shared_ptr<RomImage> rom(new RomImage);
+  rom->bytes = static_cast<uint8_t *>(p);
+  rom->mapped = size;
+  return rom;
+}
+
+RomImage::~RomImage() {
+  if (bytes != nullptr) {
+    munmap(bytes, mapped);
+  }
+}
+
+void RomImage::seal() { mprotect(bytes, mapped, PROT_READ); }
+
+uint64_t RomImage::hash() const {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+bool RomImage::save(const char *path) const {
+  std::string tmp = std::string(path) + "." + std::to_string(getpid());
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(bytes, 1, size, f) == size;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+uint32_t crc32(const uint8_t *data, size_t n, uint32_t crc) {
+  crc = ~crc;
+  for (size_t i = 0; i < n; ++i) {
+    crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+std::array<uint32_t, 4> romCrcs(const RomImage &image) {
+  std::array<uint32_t, 4> crcs = {};
+  for (size_t i = 0; i < crcs.size(); ++i) {
+    crcs[i] = crc32(image.data() + i * 0x800, 0x800);
+  }
+  return crcs;
+}
+
+const RomSet *identifyRomSet(const std::array<uint32_t, 4> &crcs) {
+  for (const RomSet &set : romSets) {
+    if (set.crc == crcs) {
+      return &set;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,63 @@
+#ifndef rom_h
+#define rom_h
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/* The 8 KB program ROM (0x0000-0x1fff). One image is shared by every
+ * Machine running it: it lives in its own page-aligned mapping which is
+ * made read-only once the ROM files have been loaded into it.
+ */
+struct RomImage {
+  static constexpr size_t size = 0x2000;
+
+  // Zero-filled and writable until seal()
+  static std::shared_ptr<RomImage> create();
+  // Sealed all-zero image for machines that haven't loaded a ROM
+  static std::shared_ptr<const RomImage> blank();
+  // A file written by save(), mapped read-only. nullptr unless it exists
+  // and is exactly size bytes.
+  static std::shared_ptr<const RomImage> map(const char *path);
+
+  ~RomImage();
+  RomImage(const RomImage &) = delete;
+  RomImage &operator=(const RomImage &) = delete;
+
+  const uint8_t *data() const { return bytes; }
+  // Only valid before seal()
+  uint8_t *writableData() { return bytes; }
+
+  void seal();
+
+  // FNV-1a of the contents, to recognize a ROM
+  uint64_t hash() const;
+
+  // Writes the image to a temporary file renamed to path, so processes
+  // starting at the same time never map half a file
+  bool save(const char *path) const;
+
+private:
+  RomImage() = default;
+  uint8_t *bytes = nullptr;
+  size_t mapped = 0;
+};
+
+// CRC-32 as zip files use it. Pass a previous result to continue it.
+uint32_t crc32(const uint8_t *data, size_t n, uint32_t crc = 0);
+
+/* A ROM set known to work: the CRC-32 of each of its four 2 KB files, in
+ * address order (invaders.h, g, f, e).
+ */
+struct RomSet {
+  const char *name;
+  std::array<uint32_t, 4> crc;
+};
+
+// The CRC-32 of each 2 KB quarter of the image
+std::array<uint32_t, 4> romCrcs(const RomImage &image);
+// The known set with those CRCs, or nullptr
+const RomSet *identifyRomSet(const std::array<uint32_t, 4> &crcs);
+
+#endif /* rom_h */
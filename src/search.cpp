@@ -0,0 +1,343 @@
+#include "./search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <unordered_set>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Input port bits
+constexpr uint8_t fire = 0b00010000;
+constexpr uint8_t left = 0b00100000;
+constexpr uint8_t right = 0b01000000;
+constexpr uint8_t read1Default = 0b10000011;
+
+// Player 1 variables in RAM
+constexpr uint16_t p1ScoreL = 0x20f8; // BCD, two lowest digits
+constexpr uint16_t p1ScoreM = 0x20f9; // BCD, two highest digits
+constexpr uint16_t p1Ships = 0x21ff;
+
+uint32_t bcd(uint8_t b) { return (b >> 4) * 10 + (b & 0xf); }
+
+// Hold choice c for the configured frames. False if the CPU stalled.
+bool play(Machine &m, const Search::Config &config, size_t c,
+          uint64_t *frames) {
+  m.setInputs(config.choices[c][0], config.choices[c][1]);
+  for (int i = 0; i < config.framesPerChoice; ++i) {
+    ++*frames;
+    if (!m.stepFrame()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Child {
+  std::shared_ptr<const PagedState> state;
+  uint64_t hash = 0;
+  double score = 0;
+  uint64_t frames = 0;
+  bool ok = false;
+};
+
+Child expand(Machine &m, const Search::Config &config,
+             const Search::Objective &objective, const PagedState &from,
+             size_t c) {
+  Child child;
+  from.applyTo(m);
+  if (!play(m, config, c, &child.frames)) {
+    return child;
+  }
+  child.state = std::make_shared<PagedState>(PagedState::of(m, &from));
+  child.hash = m.stateHash();
+  child.score = objective(m);
+  child.ok = true;
+  return child;
+}
+
+template <typename States> size_t distinctPages(const States &states) {
+  std::unordered_set<const PagedState::Page *> pages;
+  for (const PagedState *s : states) {
+    for (const auto &page : s->pages) {
+      pages.insert(page.get());
+    }
+  }
+  return pages.size();
+}
+
+/* One UCT tree, grown by one worker from the state committed to so far.
+ * Values are objective gains over the root, scaled to [0, 1] by the
+ * smallest and largest seen so far in this tree.
+ */
+struct Tree {
+  static constexpr int unexpanded = -1, dropped = -2;
+
+  struct Node {
+    std::shared_ptr<const PagedState> state;
+    std::vector<int> children; // node index, unexpanded or dropped
+    double total = 0;
+    uint32_t visits = 0;
+  };
+
+  const Search::Config &config;
+  const Search::Objective &objective;
+  std::vector<Node> nodes;
+  std::unordered_set<uint64_t> seen;
+  std::mt19937 rng;
+  double rootScore = 0, low = 0, high = 0;
+  bool valued = false;
+  uint64_t frames = 0, duplicates = 0;
+
+  Tree(const Search::Config &config, const Search::Objective &objective,
+       std::shared_ptr<const PagedState> root, uint64_t rootHash,
+       double rootScore, uint32_t seed)
+      : config(config), objective(objective), rng(seed),
+        rootScore(rootScore) {
+    add(std::move(root));
+    seen.insert(rootHash);
+  }
+
+  int add(std::shared_ptr<const PagedState> state) {
+    Node n;
+    n.state = std::move(state);
+    n.children.assign(config.choices.size(), unexpanded);
+    nodes.push_back(std::move(n));
+    return static_cast<int>(nodes.size() - 1);
+  }
+
+  double scaled(const Node &n) const {
+    double mean = n.total / n.visits;
+    return high > low ? (mean - low) / (high - low) : 0.5;
+  }
+
+  // The child of node i to go down to, dropped if none is left
+  int select(int i) const {
+    const Node &n = nodes[i];
+    double best = -std::numeric_limits<double>::infinity();
+    int chosen = dropped;
+    for (int c : n.children) {
+      if (c < 0) {
+        continue;
+      }
+      const Node &child = nodes[c];
+      double uct = scaled(child) + config.exploration *
+                                       std::sqrt(std::log(n.visits) /
+                                                 child.visits);
+      if (uct > best) {
+        best = uct;
+        chosen = c;
+      }
+    }
+    return chosen;
+  }
+
+  void iterate(Machine &m) {
+    std::vector<int> path = {0};
+    for (;;) {
+      Node &n = nodes[path.back()];
+      auto open = std::find(n.children.begin(), n.children.end(), unexpanded);
+      if (open != n.children.end()) {
+        // Expand the first choice not tried yet from here
+        size_t c = open - n.children.begin();
+        Child child = expand(m, config, objective, *n.state, c);
+        frames += child.frames;
+        if (!child.ok || !seen.insert(child.hash).second) {
+          duplicates += child.ok;
+          nodes[path.back()].children[c] = dropped;
+          return;
+        }
+        int at = add(std::move(child.state));
+        nodes[path.back()].children[c] = at;
+        path.push_back(at);
+        break;
+      }
+      int next = select(path.back());
+      if (next == dropped) {
+        return;
+      }
+      path.push_back(next);
+    }
+
+    // Random play from the new leaf; m already holds its state
+    for (int i = 0; i < config.rollout; ++i) {
+      if (!play(m, config, rng() % config.choices.size(), &frames)) {
+        break;
+      }
+    }
+    double value = objective(m) - rootScore;
+    low = valued ? std::min(low, value) : value;
+    high = valued ? std::max(high, value) : value;
+    valued = true;
+    for (int i : path) {
+      nodes[i].total += value;
+      nodes[i].visits++;
+    }
+  }
+};
+} // namespace
+
+Search::Search(const Machine &m, const Config &config, Objective objective)
+    : config(config), objective(std::move(objective)), pool(config.threads),
+      machines(pool.size(), m) {
+  start = PagedState::of(machines[0]);
+}
+
+Search::Result Search::beam() {
+  auto t0 = Clock::now();
+  Result r;
+  const size_t k = config.choices.size();
+
+  struct Node {
+    std::shared_ptr<const PagedState> state;
+    std::vector<uint8_t> path;
+    double score = 0;
+  };
+  std::vector<Node> frontier(1);
+  frontier[0].state = std::make_shared<PagedState>(start);
+  start.applyTo(machines[0]);
+  frontier[0].score = r.score = objective(machines[0]);
+  std::unordered_set<uint64_t> seen = {machines[0].stateHash()};
+  r.states = 1;
+
+  for (int d = 0; d < config.depth && k > 0; ++d) {
+    std::vector<Child> children(frontier.size() * k);
+    pool.parallelFor(children.size(), [&](size_t i, size_t worker) {
+      children[i] = expand(machines[worker], config, objective,
+                           *frontier[i / k].state, i % k);
+    });
+
+    // In order, so the same states are kept on any number of threads
+    std::vector<Node> next;
+    for (size_t i = 0; i < children.size(); ++i) {
+      Child &c = children[i];
+      r.frames += c.frames;
+      if (!c.ok) {
+        continue;
+      }
+      if (!seen.insert(c.hash).second) {
+        r.duplicates++;
+        continue;
+      }
+      Node n;
+      n.state = std::move(c.state);
+      n.path = frontier[i / k].path;
+      n.path.push_back(static_cast<uint8_t>(i % k));
+      n.score = c.score;
+      next.push_back(std::move(n));
+    }
+    r.states += next.size();
+    if (next.empty()) {
+      break;
+    }
+
+    std::stable_sort(next.begin(), next.end(),
+                     [](const Node &a, const Node &b) {
+                       return a.score > b.score;
+                     });
+    if (next.size() > static_cast<size_t>(config.width)) {
+      next.resize(config.width);
+    }
+    frontier = std::move(next);
+    if (frontier[0].score >= r.score) {
+      r.score = frontier[0].score;
+      r.choices = frontier[0].path;
+    }
+  }
+
+  std::vector<const PagedState *> kept;
+  for (const Node &n : frontier) {
+    kept.push_back(n.state.get());
+  }
+  r.pages = distinctPages(kept);
+  r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+  return r;
+}
+
+Search::Result Search::mcts() {
+  auto t0 = Clock::now();
+  Result r;
+  const size_t k = config.choices.size();
+
+  auto state = std::make_shared<const PagedState>(start);
+  std::vector<std::unique_ptr<Tree>> trees(pool.size());
+  for (int d = 0; d < config.depth && k > 0; ++d) {
+    state->applyTo(machines[0]);
+    uint64_t hash = machines[0].stateHash();
+    r.score = objective(machines[0]);
+
+    // Tree t is seeded by t and d, whichever worker grows it
+    pool.parallelFor(trees.size(), [&](size_t t, size_t worker) {
+      trees[t].reset(new Tree(config, objective, state, hash, r.score,
+                              config.seed + t * 7919 + d * 104729));
+      for (int i = 0; i < config.iterations; ++i) {
+        trees[t]->iterate(machines[worker]);
+      }
+    });
+
+    std::vector<uint64_t> visits(k);
+    for (const auto &tree : trees) {
+      r.frames += tree->frames;
+      r.duplicates += tree->duplicates;
+      r.states += tree->nodes.size() - 1;
+      for (size_t c = 0; c < k; ++c) {
+        int at = tree->nodes[0].children[c];
+        visits[c] += at >= 0 ? tree->nodes[at].visits : 0;
+      }
+    }
+    size_t best = std::max_element(visits.begin(), visits.end()) -
+                  visits.begin();
+    if (visits[best] == 0) {
+      break; // every choice stalls or leads back to a state seen
+    }
+
+    Child next = expand(machines[0], config, objective, *state, best);
+    r.frames += next.frames;
+    if (!next.ok) {
+      break;
+    }
+    state = std::move(next.state);
+    r.choices.push_back(static_cast<uint8_t>(best));
+    r.score = next.score;
+  }
+
+  std::vector<const PagedState *> kept;
+  for (const auto &tree : trees) {
+    for (const auto &n : tree ? tree->nodes : std::vector<Tree::Node>()) {
+      kept.push_back(n.state.get());
+    }
+  }
+  r.pages = distinctPages(kept);
+  r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+  return r;
+}
+
+std::vector<std::array<uint8_t, 2>> Search::inputs(const Result &r) const {
+  std::vector<std::array<uint8_t, 2>> frames;
+  for (uint8_t c : r.choices) {
+    frames.insert(frames.end(), config.framesPerChoice, config.choices[c]);
+  }
+  return frames;
+}
+
+std::vector<std::array<uint8_t, 2>> Search::invadersChoices() {
+  const uint8_t held[] = {0, fire, left, right, left | fire, right | fire};
+  std::vector<std::array<uint8_t, 2>> choices;
+  for (uint8_t bits : held) {
+    choices.push_back({bits, read1Default});
+  }
+  return choices;
+}
+
+namespace objectives {
+double score(const Machine &m) {
+  return bcd(m.cpu.read(p1ScoreM)) * 100 + bcd(m.cpu.read(p1ScoreL));
+}
+
+double lives(const Machine &m) { return m.cpu.read(p1Ships); }
+
+double played(const Machine &m) { return score(m) + 1000 * lives(m); }
+} // namespace objectives
@@ -0,0 +1,83 @@
+#ifndef search_h
+#define search_h
+#include "./machine.h"
+#include "./snapshot.h"
+#include "./threadpool.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Search over input sequences from a start state, for tool-assisted runs
+ * and bots. A sequence is a list of choices, each an input held for a few
+ * frames. Every state reached is a PagedState (snapshot.h), so branches
+ * share the RAM pages they didn't write. A state whose hash was already
+ * reached by another sequence is dropped. Sequences are scored by an
+ * objective that reads the machine, usually its RAM.
+ *
+ * beam() keeps the best width states after every choice. mcts() runs
+ * independent UCT trees on every worker from the current state, commits to
+ * the choice they visited most between them and starts over from there.
+ * Both spread the expansions over a work-stealing pool with one Machine
+ * per worker, and give the same result for the same config on any number
+ * of threads (mcts() for the same number of threads).
+ */
+struct Search {
+  using Objective = std::function<double(const Machine &)>;
+
+  struct Config {
+    // Read0, Read1 of every choice
+    std::vector<std::array<uint8_t, 2>> choices;
+    int framesPerChoice = 8;
+    int depth = 60; // choices per sequence
+    // beam()
+    int width = 64;
+    // mcts(), per worker and committed choice
+    int iterations = 64;
+    int rollout = 8; // random choices after the tree
+    double exploration = 1.4;
+    uint32_t seed = 1;
+    size_t threads = std::thread::hardware_concurrency();
+  };
+
+  struct Result {
+    std::vector<uint8_t> choices; // indexes into Config::choices
+    double score = 0;
+    uint64_t frames = 0;     // emulated, over every worker
+    uint64_t states = 0;     // distinct states reached
+    uint64_t duplicates = 0; // states dropped as already reached
+    size_t pages = 0;        // RAM pages held by the states kept at the end
+    double seconds = 0;
+  };
+
+  // m is copied for every worker, with its ROM, ports, hle and fusion
+  Search(const Machine &m, const Config &config, Objective objective);
+
+  Result beam();
+  Result mcts();
+
+  // The Read0, Read1 of every frame of a result, as a movie records them
+  std::vector<std::array<uint8_t, 2>> inputs(const Result &r) const;
+
+  // The left, right and fire combinations VecEnv plays with
+  static std::vector<std::array<uint8_t, 2>> invadersChoices();
+
+private:
+  Config config;
+  Objective objective;
+  ThreadPool pool;
+  std::vector<Machine> machines; // one per worker
+  PagedState start;
+};
+
+// Objectives for Space Invaders
+namespace objectives {
+double score(const Machine &m);  // player 1 score
+double lives(const Machine &m);  // player 1 ships left
+double played(const Machine &m); // score, plus 1000 per ship left
+} // namespace objectives
+
+#endif /* search_h */
@@ -0,0 +1,239 @@
+#include "./snapshot.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace {
+const char magic[4] = {'S', 'I', 'S', 'T'};
+const uint16_t version = 1;
+
+template <typename T> bool readLE(FILE *f, T *v) {
+  uint8_t buf[sizeof(T)];
+  if (fread(buf, 1, sizeof(T), f) != sizeof(T)) {
+    return false;
+  }
+  *v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    *v |= static_cast<T>(buf[i]) << (8 * i);
+  }
+  return true;
+}
+
+template <typename T> bool writeLE(FILE *f, T v) {
+  uint8_t buf[sizeof(T)];
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buf[i] = (v >> (8 * i)) & 0xff;
+  }
+  return fwrite(buf, 1, sizeof(T), f) == sizeof(T);
+}
+
+bool readBool(FILE *f, bool *b) {
+  uint8_t v = 0;
+  bool ok = readLE(f, &v);
+  *b = v != 0;
+  return ok;
+}
+
+// Everything but RAM
+void applyRegisters(const MachineState &s, Machine &m) {
+  static_cast<CpuState &>(m.cpu) = s.cpu;
+  m.cpu.shifter = s.shifter;
+  m.cpu.Read0 = s.read0;
+  m.cpu.Read1 = s.read1;
+  m.interruptSwitch = s.interruptSwitch;
+  m.frames = s.frames;
+  m.totalCycles = s.totalCycles;
+}
+
+std::string cachePath(uint64_t romHash, int frames) {
+  const char *dir = getenv("SI_BOOT_CACHE");
+  if (dir == nullptr) {
+    return "";
+  }
+  char name[48];
+  snprintf(name, sizeof(name), "/%016llx-%d.sist",
+           static_cast<unsigned long long>(romHash), frames);
+  return dir + std::string(name);
+}
+} // namespace
+
+MachineState MachineState::of(const Machine &m, bool withRam) {
+  MachineState s;
+  s.romHash = m.rom->hash();
+  s.cpu = m.cpu;
+  s.shifter = m.cpu.shifter;
+  s.read0 = m.cpu.Read0;
+  s.read1 = m.cpu.Read1;
+  s.interruptSwitch = m.interruptSwitch;
+  s.frames = m.frames;
+  s.totalCycles = m.totalCycles;
+  if (withRam) {
+    s.ram = m.cpu.ram;
+  }
+  return s;
+}
+
+bool MachineState::applyTo(Machine &m) const {
+  if (m.rom->hash() != romHash || m.cpu.ram.size() != ram.size()) {
+    return false;
+  }
+  applyRegisters(*this, m);
+  std::copy(ram.begin(), ram.end(), m.cpu.ram.begin());
+  m.cpu.markAllDirty();
+  return true;
+}
+
+void MachineState::restore(Machine &m) const {
+  applyRegisters(*this, m);
+
+  const size_t pageSize = intel8080::pageSize;
+  for (size_t w = 0; w < m.cpu.dirty.size(); ++w) {
+    for (uint64_t bits = m.cpu.dirty[w]; bits != 0; bits &= bits - 1) {
+      size_t at = (w * 64 + __builtin_ctzll(bits)) * pageSize;
+      if (at >= ram.size()) {
+        break;
+      }
+      memcpy(m.cpu.ram.data() + at, ram.data() + at, pageSize);
+    }
+  }
+  m.cpu.clearDirty();
+}
+
+PagedState PagedState::of(const Machine &m, const PagedState *base) {
+  PagedState s;
+  s.registers = MachineState::of(m, false);
+
+  const size_t n = m.cpu.ram.size() / intel8080::pageSize;
+  const bool share = base != nullptr && base->pages.size() == n;
+  s.pages.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    if (share && !(m.cpu.dirty[i / 64] >> (i % 64) & 1)) {
+      s.pages[i] = base->pages[i];
+      continue;
+    }
+    auto page = std::make_shared<Page>();
+    memcpy(page->data(), m.cpu.ram.data() + i * intel8080::pageSize,
+           intel8080::pageSize);
+    s.pages[i] = std::move(page);
+  }
+  return s;
+}
+
+void PagedState::applyTo(Machine &m) const {
+  applyRegisters(registers, m);
+  for (size_t i = 0; i < pages.size(); ++i) {
+    memcpy(m.cpu.ram.data() + i * intel8080::pageSize, pages[i]->data(),
+           intel8080::pageSize);
+  }
+  m.cpu.clearDirty();
+}
+
+size_t PagedState::ownPages() const {
+  size_t n = 0;
+  for (const auto &page : pages) {
+    n += page.use_count() == 1;
+  }
+  return n;
+}
+
+bool MachineState::load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  char m[4];
+  uint16_t ver = 0, reserved = 0;
+  uint8_t psw = 0;
+  uint32_t ramSize = 0;
+  bool ok = fread(m, 1, 4, f) == 4 && memcmp(m, magic, 4) == 0 &&
+            readLE(f, &ver) && ver == version && readLE(f, &reserved) &&
+            readLE(f, &romHash) && readLE(f, &frames) &&
+            readLE(f, &totalCycles) && readLE(f, &cpu.pc) &&
+            readLE(f, &cpu.sp) && readLE(f, &cpu.cycles) &&
+            readLE(f, &cpu.A) && readLE(f, &cpu.B) && readLE(f, &cpu.C) &&
+            readLE(f, &cpu.D) && readLE(f, &cpu.E) && readLE(f, &cpu.H) &&
+            readLE(f, &cpu.L) && readLE(f, &psw) &&
+            readBool(f, &cpu.interrupts) && readBool(f, &interruptSwitch) &&
+            readLE(f, &read0) && readLE(f, &read1) &&
+            readLE(f, &shifter.value) && readLE(f, &shifter.amount) &&
+            shifter.amount < 8 && readLE(f, &ramSize) && ramSize <= 0x10000;
+
+  if (ok) {
+    cpu.f = psw;
+    shifter.update();
+    ram.resize(ramSize);
+    ok = fread(ram.data(), 1, ramSize, f) == ramSize;
+  }
+  fclose(f);
+  return ok;
+}
+
+bool MachineState::save(const char *path) const {
+  std::string tmp = std::string(path) + "." + std::to_string(getpid());
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  auto ramSize = static_cast<uint32_t>(ram.size());
+  bool ok = fwrite(magic, 1, 4, f) == 4 && writeLE(f, version) &&
+            writeLE<uint16_t>(f, 0) && writeLE(f, romHash) &&
+            writeLE(f, frames) && writeLE(f, totalCycles) &&
+            writeLE(f, cpu.pc) && writeLE(f, cpu.sp) &&
+            writeLE(f, cpu.cycles) && writeLE(f, cpu.A) &&
+            writeLE(f, cpu.B) && writeLE(f, cpu.C) && writeLE(f, cpu.D) &&
+            writeLE(f, cpu.E) && writeLE(f, cpu.H) && writeLE(f, cpu.L) &&
+            writeLE(f, cpu.f.psw()) &&
+            writeLE<uint8_t>(f, cpu.interrupts) &&
+            writeLE<uint8_t>(f, interruptSwitch) && writeLE(f, read0) &&
+            writeLE(f, read1) && writeLE(f, shifter.value) &&
+            writeLE(f, shifter.amount) && writeLE(f, ramSize) &&
+            fwrite(ram.data(), 1, ramSize, f) == ramSize;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<const MachineState> bootState(const Machine &m, int frames) {
+  static std::mutex mutex;
+  static std::map<std::pair<uint64_t, int>, std::shared_ptr<const MachineState>>
+      booted;
+
+  uint64_t romHash = m.rom->hash();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &state = booted[{romHash, frames}];
+  if (state != nullptr) {
+    return state;
+  }
+
+  std::string cache = cachePath(romHash, frames);
+  auto s = std::make_shared<MachineState>();
+  if (cache.empty() || !s->load(cache.c_str()) || s->romHash != romHash ||
+      s->ram.size() != m.cpu.ram.size()) {
+    // A machine of its own, so m's hooks, sound and so on aren't involved
+    Machine boot;
+    boot.setRom(m.rom);
+    boot.reset();
+    for (int i = 0; i < frames; ++i) {
+      boot.stepFrame();
+    }
+    *s = MachineState::of(boot);
+    if (!cache.empty()) {
+      s->save(cache.c_str());
+    }
+  }
+  state = s;
+  return state;
+}
@@ -0,0 +1,75 @@
+#ifndef snapshot_h
+#define snapshot_h
+#include "./machine.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* Everything a Machine needs to carry on from where another one was,
+ * other than the ROM: registers, flags, shifter, inputs, interrupt
+ * schedule, counters and RAM. Hooks, sound, ports, hle and fusion belong
+ * to the machine it is applied to and are left alone.
+ *
+ * File layout (little endian):
+ *   "SIST" | u16 version | u16 reserved | u64 ROM hash | u64 frames
+ *   u64 total cycles | u16 pc | u16 sp | u32 cycles | u8 A B C D E H L
+ *   u8 flags (as PUSH PSW) | u8 interrupts | u8 interrupt switch
+ *   u8 Read0 | u8 Read1 | u16 shifter value | u8 shift amount
+ *   u32 RAM size | RAM
+ */
+struct MachineState {
+  uint64_t romHash = 0;
+  CpuState cpu = {};
+  intel8080::Shifter shifter;
+  uint8_t read0 = 0, read1 = 0;
+  bool interruptSwitch = false;
+  uint64_t frames = 0, totalCycles = 0;
+  std::vector<uint8_t> ram;
+
+  // Without RAM, ram is left empty
+  static MachineState of(const Machine &m, bool withRam = true);
+  // False, leaving m as it was, if m runs another ROM or has another
+  // amount of RAM
+  bool applyTo(Machine &m) const;
+  // applyTo for a machine that had this state when its dirty pages were
+  // last cleared: only the RAM pages written since are copied back, and
+  // the bits are cleared again. Nothing is checked.
+  void restore(Machine &m) const;
+
+  bool load(const char *path);
+  // Through a temporary file renamed to path
+  bool save(const char *path) const;
+};
+
+/* A MachineState whose RAM is held as shared, read-only pages. A state
+ * taken from a machine that was loaded from another PagedState keeps the
+ * pages of that one it didn't write (by the dirty bits), so states that
+ * branch from each other share their unchanged memory copy-on-write.
+ */
+struct PagedState {
+  using Page = std::array<uint8_t, intel8080::pageSize>;
+
+  MachineState registers; // ram left empty
+  std::vector<std::shared_ptr<const Page>> pages;
+
+  // base, if given, is the state m was loaded from with applyTo and has
+  // run from since
+  static PagedState of(const Machine &m, const PagedState *base = nullptr);
+  // Copies every page and clears the dirty bits. Nothing is checked.
+  void applyTo(Machine &m) const;
+  // Pages held by this state only
+  size_t ownPages() const;
+};
+
+/* The state frames frames after power-on with no input: the self-test and
+ * RAM clear are done and the attract mode is running. Booted once per ROM
+ * and number of frames in a process and shared from then on. With
+ * SI_BOOT_CACHE=<dir> it is also kept there, by ROM hash, for the next
+ * processes.
+ */
+std::shared_ptr<const MachineState> bootState(const Machine &m,
+                                              int frames = 120);
+
+#endif /* snapshot_h */
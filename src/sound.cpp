@@ -0,0 +1,266 @@
+#include "./sound.h"
+#include "./wav.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+constexpr double pi = 3.14159265358979323846;
+constexpr double volume = 6000;
+
+// shape(t, phase) returns the waveform in -1..1, phase is advanced by the
+// caller with the frequency returned through freq
+template <typename Shape>
+std::vector<int16_t> synth(double seconds, Shape shape) {
+  std::vector<int16_t> out(static_cast<size_t>(seconds * Sound::sampleRate));
+  double phase = 0;
+  for (size_t i = 0; i < out.size(); ++i) {
+    double t = static_cast<double>(i) / Sound::sampleRate;
+    double freq = 0;
+    double v = shape(t, phase, freq);
+    phase += freq / Sound::sampleRate;
+    phase -= std::floor(phase);
+    out[i] = static_cast<int16_t>(std::max(-1.0, std::min(1.0, v)) * volume);
+  }
+  return out;
+}
+
+double square(double phase) { return phase < 0.5 ? 1 : -1; }
+
+// Deterministic white noise in -1..1
+struct Noise {
+  uint32_t state = 0x12345678;
+  double operator()() {
+    state = state * 1664525 + 1013904223;
+    return static_cast<int32_t>(state) / 2147483648.0;
+  }
+};
+
+std::vector<int16_t> synthesize(Sound::Effect e) {
+  Noise noise;
+  double lowpass = 0;
+  switch (e) {
+  case Sound::Ufo:
+    // One period of the warble, so it loops cleanly
+    return synth(0.1, [](double t, double phase, double &freq) {
+      freq = 900 + 300 * std::sin(2 * pi * 10 * t);
+      return 0.6 * square(phase);
+    });
+  case Sound::Shot:
+    return synth(0.35, [&](double t, double phase, double &freq) {
+      freq = 1500 - 3000 * t;
+      return (1 - t / 0.35) * (0.7 * square(phase) + 0.3 * noise());
+    });
+  case Sound::PlayerDie:
+    return synth(1.2, [&](double t, double, double &) {
+      lowpass += 0.08 * (noise() - lowpass);
+      return 4 * lowpass * std::exp(-2.5 * t);
+    });
+  case Sound::InvaderDie:
+    return synth(0.3, [&](double t, double phase, double &freq) {
+      freq = 600 - 1300 * t;
+      lowpass += 0.3 * (noise() - lowpass);
+      return (1 - t / 0.3) * (0.5 * square(phase) + lowpass);
+    });
+  case Sound::Fleet1:
+  case Sound::Fleet2:
+  case Sound::Fleet3:
+  case Sound::Fleet4: {
+    // The four descending notes of the march
+    static const double notes[] = {110, 98, 87, 82};
+    double note = notes[e - Sound::Fleet1];
+    return synth(0.09, [&](double t, double phase, double &freq) {
+      freq = note;
+      return (1 - t / 0.09) * square(phase);
+    });
+  }
+  case Sound::UfoHit:
+    return synth(1.0, [](double t, double phase, double &freq) {
+      freq = 400 + 200 * std::sin(2 * pi * 16 * t);
+      return (1 - t) * square(phase);
+    });
+  case Sound::ExtraLife:
+    return synth(0.8, [](double t, double phase, double &freq) {
+      freq = 1000;
+      return std::fmod(t * 8, 1.0) < 0.5 ? 0.6 * square(phase) : 0;
+    });
+  default:
+    return {};
+  }
+}
+
+// Which effect each port bit starts
+const Sound::Effect port3Effects[] = {Sound::Ufo, Sound::Shot, Sound::PlayerDie,
+                                      Sound::InvaderDie, Sound::ExtraLife};
+const Sound::Effect port5Effects[] = {Sound::Fleet1, Sound::Fleet2,
+                                      Sound::Fleet3, Sound::Fleet4,
+                                      Sound::UfoHit};
+constexpr uint8_t ampEnable = 0b00100000;
+} // namespace
+
+AudioRing::AudioRing(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  buffer.assign(size, 0);
+  mask = size - 1;
+}
+
+size_t AudioRing::push(const int16_t *samples, size_t n) {
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t t = tail.load(std::memory_order_acquire);
+  n = std::min(n, buffer.size() - (h - t));
+  for (size_t i = 0; i < n; ++i) {
+    buffer[(h + i) & mask] = samples[i];
+  }
+  head.store(h + n, std::memory_order_release);
+  return n;
+}
+
+size_t AudioRing::pop(int16_t *out, size_t n) {
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t h = head.load(std::memory_order_acquire);
+  n = std::min(n, h - t);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = buffer[(t + i) & mask];
+  }
+  tail.store(t + n, std::memory_order_release);
+  return n;
+}
+
+size_t AudioRing::size() const {
+  return head.load(std::memory_order_acquire) -
+         tail.load(std::memory_order_acquire);
+}
+
+Sound::Sound(size_t ringSamples) : ring(ringSamples) {
+  for (int e = 0; e < EffectCount; ++e) {
+    samples[e] = synthesize(static_cast<Effect>(e));
+  }
+}
+
+int Sound::loadSamples(const char *dir) {
+  int loaded = 0;
+  for (int e = 0; e < EffectCount; ++e) {
+    std::string path = std::string(dir) + "/" + std::to_string(e) + ".wav";
+    std::vector<int16_t> s;
+    if (wav::load(path.c_str(), sampleRate, s) && !s.empty()) {
+      samples[e] = std::move(s);
+      voices[e] = Voice();
+      loaded++;
+    }
+  }
+  return loaded;
+}
+
+void Sound::portWrite(uint8_t port, uint8_t value, uint32_t cycles) {
+  if (port != 3 && port != 5) {
+    return;
+  }
+  uint8_t &latch = port == 3 ? port3 : port5;
+  uint8_t changed = latch ^ value;
+  if (changed == 0) {
+    return;
+  }
+
+  // Everything before the write plays with the old bits
+  mixTo(base + cycles);
+  latch = value;
+
+  const Effect *effects = port == 3 ? port3Effects : port5Effects;
+  for (int bit = 0; bit < 5; ++bit) {
+    if ((changed >> bit) & 1) {
+      edge(effects[bit], (value >> bit) & 1);
+    }
+  }
+}
+
+void Sound::edge(Effect e, bool on) {
+  edges.fetch_add(1, std::memory_order_relaxed);
+  Voice &v = voices[e];
+  if (on) {
+    // Retriggering restarts the sample
+    v.pos = 0;
+    v.playing = !samples[e].empty();
+  } else if (e == Ufo) {
+    // The only effect that stops when its bit drops
+    v.playing = false;
+  }
+}
+
+void Sound::endHalfFrame(uint32_t cycles) {
+  base += cycles;
+  mixTo(base);
+}
+
+void Sound::mixTo(uint64_t cycle) {
+  uint64_t target = cycle * sampleRate / cpuHz;
+  bool amp = port3 & ampEnable;
+
+  while (mixed < target) {
+    size_t n = std::min<uint64_t>(chunkSamples, target - mixed);
+    std::array<int32_t, chunkSamples> sum;
+    std::fill(sum.begin(), sum.begin() + n, 0);
+
+    for (int e = 0; e < EffectCount; ++e) {
+      Voice &v = voices[e];
+      const std::vector<int16_t> &s = samples[e];
+      for (size_t i = 0; i < n && v.playing;) {
+        size_t run = std::min(n - i, s.size() - v.pos);
+        for (size_t k = 0; k < run; ++k) {
+          sum[i + k] += s[v.pos + k];
+        }
+        i += run;
+        v.pos += run;
+        if (v.pos == s.size()) {
+          // The UFO repeats for as long as its bit is held
+          v.pos = 0;
+          v.playing = e == Ufo && (port3 & 1);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      chunk[i] = amp ? static_cast<int16_t>(
+                           std::max(-32768, std::min(32767, sum[i])))
+                     : 0;
+    }
+    size_t pushed = ring.push(chunk.data(), n);
+    produced.fetch_add(n, std::memory_order_relaxed);
+    dropped.fetch_add(n - pushed, std::memory_order_relaxed);
+    mixed += n;
+  }
+}
+
+void Sound::pull(int16_t *out, size_t n) {
+  auto queued = static_cast<uint32_t>(ring.size());
+  latencySamples.store(queued, std::memory_order_relaxed);
+  if (queued > maxLatencySamples.load(std::memory_order_relaxed)) {
+    maxLatencySamples.store(queued, std::memory_order_relaxed);
+  }
+
+  size_t got = ring.pop(out, n);
+  if (got < n) {
+    std::fill(out + got, out + n, 0);
+    underruns.fetch_add(1, std::memory_order_relaxed);
+    silence.fetch_add(n - got, std::memory_order_relaxed);
+  }
+  pulled.fetch_add(got, std::memory_order_relaxed);
+}
+
+Sound::Stats Sound::stats() const {
+  Stats s;
+  s.edges = edges.load(std::memory_order_relaxed);
+  s.produced = produced.load(std::memory_order_relaxed);
+  s.dropped = dropped.load(std::memory_order_relaxed);
+  s.pulled = pulled.load(std::memory_order_relaxed);
+  s.underruns = underruns.load(std::memory_order_relaxed);
+  s.silence = silence.load(std::memory_order_relaxed);
+  s.latencyMs = latencySamples.load(std::memory_order_relaxed) * 1000.0 /
+                sampleRate;
+  s.maxLatencyMs = maxLatencySamples.load(std::memory_order_relaxed) *
+                   1000.0 / sampleRate;
+  return s;
+}
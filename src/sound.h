@@ -0,0 +1,117 @@
+#ifndef sound_h
+#define sound_h
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Single producer, single consumer ring of audio samples. The emulation
+ * thread pushes, the audio output pulls; neither ever blocks or allocates.
+ */
+struct AudioRing {
+  // capacity is rounded up to a power of two
+  explicit AudioRing(size_t capacity);
+
+  // Both return how many samples were actually copied
+  size_t push(const int16_t *samples, size_t n);
+  size_t pop(int16_t *out, size_t n);
+
+  size_t size() const;
+  size_t capacity() const { return buffer.size(); }
+
+private:
+  std::vector<int16_t> buffer;
+  size_t mask;
+  // Apart so producer and consumer don't share a cache line
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+/* The Space Invaders sound board. The game switches sounds with the bits
+ * of output ports 3 and 5:
+ *   port 3: 0 UFO (repeats while set), 1 shot, 2 player dies,
+ *           3 invader dies, 4 extended play, 5 amplifier enable
+ *   port 5: 0-3 fleet movement 1-4, 4 UFO hit
+ * Every bit edge is timestamped in emulated CPU cycles and the mixer
+ * renders up to that point before applying it, so sounds start on the
+ * sample the game asked for no matter how the emulation is paced.
+ *
+ * Effects use the usual sample set (0.wav-9.wav) when loadSamples()
+ * finds it, synthesized equivalents otherwise.
+ */
+struct Sound {
+  static constexpr int sampleRate = 44100;
+  static constexpr uint32_t cpuHz = 2000000;
+
+  // Numbered like the sample set
+  enum Effect {
+    Ufo,
+    Shot,
+    PlayerDie,
+    InvaderDie,
+    Fleet1,
+    Fleet2,
+    Fleet3,
+    Fleet4,
+    UfoHit,
+    ExtraLife,
+    EffectCount
+  };
+
+  struct Stats {
+    uint64_t edges = 0;     // effects switched on or off
+    uint64_t produced = 0;  // samples mixed
+    uint64_t dropped = 0;   // mixed samples lost because the ring was full
+    uint64_t pulled = 0;    // samples handed to the output
+    uint64_t underruns = 0; // pulls the ring couldn't fill
+    uint64_t silence = 0;   // samples of silence those were padded with
+    double latencyMs = 0;   // audio queued in the ring at the last pull
+    double maxLatencyMs = 0;
+  };
+
+  explicit Sound(size_t ringSamples = 8192);
+
+  // Use dir/0.wav ... dir/9.wav where present. Returns how many loaded.
+  int loadSamples(const char *dir);
+
+  // Emulation thread. cycles counts from the last interrupt, like
+  // intel8080::cycles.
+  void portWrite(uint8_t port, uint8_t value, uint32_t cycles);
+  // Mixes up to the interrupt and starts counting from it
+  void endHalfFrame(uint32_t cycles);
+
+  // Output thread. Always fills n samples, padding with silence.
+  void pull(int16_t *out, size_t n);
+
+  Stats stats() const;
+
+  AudioRing ring;
+
+private:
+  struct Voice {
+    size_t pos = 0;
+    bool playing = false;
+  };
+
+  std::array<std::vector<int16_t>, EffectCount> samples;
+  std::array<Voice, EffectCount> voices;
+  uint8_t port3 = 0, port5 = 0;
+
+  uint64_t base = 0;   // cycles up to the last interrupt
+  uint64_t mixed = 0;  // samples rendered so far
+
+  // Mixer output, reused for every chunk
+  static constexpr size_t chunkSamples = 512;
+  std::array<int16_t, chunkSamples> chunk;
+
+  std::atomic<uint64_t> edges{0}, produced{0}, dropped{0};
+  std::atomic<uint64_t> pulled{0}, underruns{0}, silence{0};
+  std::atomic<uint32_t> latencySamples{0}, maxLatencySamples{0};
+
+  void edge(Effect e, bool on);
+  void mixTo(uint64_t cycle);
+};
+
+#endif /* sound_h */
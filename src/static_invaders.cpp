@@ -0,0 +1,40 @@
+#include "./static_invaders.h"
+
+StaticInvaders::StaticInvaders(Machine &m)
+    : translated(m.rom != nullptr && m.rom->hash() == staticcode::romHash),
+      m(m) {}
+
+bool StaticInvaders::stepHalfFrame() {
+  intel8080 &cpu = m.cpu;
+  uint32_t start = cpu.cycles;
+  // The loop of Machine::stepHalfFrame, with blocks run in between
+  while (!(cpu.interrupts && cpu.cycles >= Machine::halfFrameCycles)) {
+    // Only the ROM is translated
+    if (translated && cpu.pc < cpu.romEnd) {
+      m.instructions += staticcode::run(cpu, start);
+      if (due(cpu, start)) {
+        if (cpu.cycles - start > Machine::halfFrameCycles * 64) {
+          return false;
+        }
+        break;
+      }
+    }
+    cpu.step<ProductionFeatures>();
+    interpreted++;
+    m.instructions++;
+    if (cpu.cycles - start > Machine::halfFrameCycles * 64) {
+      return false;
+    }
+  }
+
+  m.deliverInterrupt();
+  return true;
+}
+
+bool StaticInvaders::stepFrame() {
+  bool ok = stepHalfFrame() && stepHalfFrame();
+  if (ok) {
+    m.frames++;
+  }
+  return ok;
+}
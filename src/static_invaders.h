@@ -0,0 +1,51 @@
+#ifndef static_invaders_h
+#define static_invaders_h
+#include "./machine.h"
+
+#include <cstdint>
+
+/* Runs a Machine on code recompiled ahead of time from its ROM.
+ * tools/recompile.cpp follows the code from the reset and RST vectors and
+ * writes every basic block it finds as a case of one switch on pc. Each
+ * instruction is intel8080::execute (dispatcher.h) with its opcode as a
+ * constant, which the compiler folds down to the interpreter's own case,
+ * so there is no fetch or decode and the state matches the interpreter
+ * instruction for instruction. Whatever the analysis didn't reach (code in
+ * RAM, PCHL targets, the middle of a block) runs on the interpreter.
+ *
+ * The generated file only fits the ROM it was made from; with any other
+ * ROM every instruction is interpreted.
+ */
+struct StaticInvaders {
+  explicit StaticInvaders(Machine &m);
+
+  // The ROM is the one the code was generated from
+  bool translated = false;
+  // Instructions that ran on the interpreter
+  uint64_t interpreted = 0;
+
+  // Same contract as Machine::stepHalfFrame and stepFrame
+  bool stepHalfFrame();
+  bool stepFrame();
+
+  // Whether the half frame loop must look after the last instruction: the
+  // interrupt is due, or the CPU is stalled
+  static bool due(const intel8080 &cpu, uint32_t start) {
+    return (cpu.interrupts && cpu.cycles >= Machine::halfFrameCycles) ||
+           cpu.cycles - start > Machine::halfFrameCycles * 64;
+  }
+
+private:
+  Machine &m;
+};
+
+// Written by tools/recompile.cpp
+namespace staticcode {
+extern const uint64_t romHash;
+extern const uint32_t blocks;
+// Runs blocks until due() or pc isn't the start of one. Returns the
+// instructions it ran.
+uint64_t run(intel8080 &cpu, uint32_t start);
+} // namespace staticcode
+
+#endif /* static_invaders_h */
@@ -0,0 +1,145 @@
+#ifndef threadpool_h
+#define threadpool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Work-stealing thread pool. Every worker has its own deque: it pops work
+ * from the back of its own queue and, when that is empty, steals from the
+ * front of the others. Tasks receive the index of the worker running them
+ * so they can use per-worker state (e.g. one Machine per worker).
+ */
+class ThreadPool {
+public:
+  using Task = std::function<void(size_t worker)>;
+
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+      queues.emplace_back(new Queue);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this, i] { run(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : workers) {
+      t.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  // Tasks are dealt round-robin; idle workers steal the rest
+  void submit(Task task) {
+    size_t q = next++ % queues.size();
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      pending++;
+      queued++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues[q]->mutex);
+      queues[q]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+  }
+
+  // Block until every submitted task has finished
+  void wait() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    done.wait(lock, [this] { return pending == 0; });
+  }
+
+  // Run fn(i, worker) for i in [0, n) and wait for all of them
+  template <typename F> void parallelFor(size_t n, F fn) {
+    for (size_t i = 0; i < n; ++i) {
+      submit([i, &fn](size_t worker) { fn(i, worker); });
+    }
+    wait();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next{0};
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  size_t pending = 0;             // submitted and not finished
+  std::atomic<size_t> queued{0}; // submitted and not yet picked up
+  bool stopping = false;
+
+  bool popOwn(size_t i, Task *task) {
+    std::lock_guard<std::mutex> lock(queues[i]->mutex);
+    if (queues[i]->tasks.empty()) {
+      return false;
+    }
+    *task = std::move(queues[i]->tasks.back());
+    queues[i]->tasks.pop_back();
+    queued--;
+    return true;
+  }
+
+  bool steal(size_t i, Task *task) {
+    for (size_t k = 1; k < queues.size(); ++k) {
+      Queue &victim = *queues[(i + k) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        *task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t i) {
+    for (;;) {
+      Task task;
+      if (popOwn(i, &task) || steal(i, &task)) {
+        task(i);
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        if (--pending == 0) {
+          done.notify_all();
+        }
+        continue;
+      }
+
+      // Nothing to do: sleep until new work arrives
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this] { return stopping || queued > 0; });
+      if (stopping) {
+        return;
+      }
+    }
+  }
+};
+
+#endif /* threadpool_h */
@@ -0,0 +1,232 @@
+#include "./trace.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+const char magic[4] = {'S', 'I', 'T', 'R'};
+const uint16_t version = 1;
+
+// Mask of the bytes that changed, then those bytes
+void encode(const uint8_t *cur, uint8_t *prev, std::vector<uint8_t> &out) {
+  uint16_t mask = 0;
+  for (size_t i = 0; i < TraceRecord::size; ++i) {
+    if (cur[i] != prev[i]) {
+      mask |= 1 << i;
+    }
+  }
+  out.push_back(mask & 0xff);
+  out.push_back(mask >> 8);
+  for (size_t i = 0; i < TraceRecord::size; ++i) {
+    if ((mask >> i) & 1) {
+      out.push_back(cur[i]);
+    }
+  }
+  memcpy(prev, cur, TraceRecord::size);
+}
+} // namespace
+
+void TraceRecord::toBytes(uint8_t *b) const {
+  b[0] = pc & 0xff;
+  b[1] = pc >> 8;
+  b[2] = sp & 0xff;
+  b[3] = sp >> 8;
+  b[4] = op;
+  b[5] = A;
+  b[6] = B;
+  b[7] = C;
+  b[8] = D;
+  b[9] = E;
+  b[10] = H;
+  b[11] = L;
+  b[12] = psw;
+  b[13] = cycles;
+  b[14] = interrupts;
+  b[15] = reserved;
+}
+
+void TraceRecord::fromBytes(const uint8_t *b) {
+  pc = b[0] | (b[1] << 8);
+  sp = b[2] | (b[3] << 8);
+  op = b[4];
+  A = b[5];
+  B = b[6];
+  C = b[7];
+  D = b[8];
+  E = b[9];
+  H = b[10];
+  L = b[11];
+  psw = b[12];
+  cycles = b[13];
+  interrupts = b[14];
+  reserved = b[15];
+}
+
+// Reader
+
+TraceReader::~TraceReader() {
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+bool TraceReader::open(const char *path) {
+  if (file != nullptr) {
+    fclose(file);
+  }
+  file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  memset(prev, 0, sizeof(prev));
+  uint8_t header[8];
+  bool ok = fread(header, 1, 8, file) == 8 && memcmp(header, magic, 4) == 0 &&
+            (header[4] | (header[5] << 8)) == version &&
+            (header[6] | (header[7] << 8)) == TraceRecord::size;
+  // Not a trace: nothing stays open, so the caller can try another format
+  if (!ok) {
+    fclose(file);
+    file = nullptr;
+  }
+  return ok;
+}
+
+bool TraceReader::next(TraceRecord &r) {
+  int lo = getc(file);
+  int hi = getc(file);
+  if (lo == EOF || hi == EOF) {
+    return false;
+  }
+  int mask = lo | (hi << 8);
+  for (size_t i = 0; i < TraceRecord::size; ++i) {
+    if ((mask >> i) & 1) {
+      int b = getc(file);
+      if (b == EOF) {
+        return false;
+      }
+      prev[i] = static_cast<uint8_t>(b);
+    }
+  }
+  r.fromBytes(prev);
+  return true;
+}
+
+// Writer
+
+Tracer::Tracer(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  ring.resize(size);
+  mask = size - 1;
+}
+
+Tracer::~Tracer() { close(); }
+
+bool Tracer::open(const char *path) {
+  close();
+  file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const uint8_t header[8] = {
+      static_cast<uint8_t>(magic[0]), static_cast<uint8_t>(magic[1]),
+      static_cast<uint8_t>(magic[2]), static_cast<uint8_t>(magic[3]),
+      version & 0xff, version >> 8, TraceRecord::size, 0};
+  ok = fwrite(header, 1, 8, file) == 8;
+  bytes = 8;
+  records = 0;
+  waits = 0;
+  head = 0;
+  tail = 0;
+  running = true;
+  writer = std::thread([this] { writeLoop(); });
+  return ok;
+}
+
+bool Tracer::close() {
+  if (file == nullptr) {
+    return false;
+  }
+  running.store(false, std::memory_order_release);
+  writer.join();
+  ok = fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
+
+void Tracer::before(const intel8080 &cpu) {
+  if (file == nullptr) {
+    return;
+  }
+  pending.pc = cpu.pc;
+  pending.sp = cpu.sp;
+  pending.op = cpu.read(cpu.pc);
+  pending.A = cpu.A;
+  pending.B = cpu.B;
+  pending.C = cpu.C;
+  pending.D = cpu.D;
+  pending.E = cpu.E;
+  pending.H = cpu.H;
+  pending.L = cpu.L;
+  pending.psw = cpu.f.psw();
+  pending.interrupts = cpu.interrupts;
+  startCycles = cpu.cycles;
+}
+
+void Tracer::after(const intel8080 &cpu) {
+  if (file == nullptr) {
+    return;
+  }
+  pending.cycles = static_cast<uint8_t>(cpu.cycles - startCycles);
+
+  size_t h = head.load(std::memory_order_relaxed);
+  while (h - tail.load(std::memory_order_acquire) == ring.size()) {
+    waits++;
+    std::this_thread::yield();
+  }
+  ring[h & mask] = pending;
+  head.store(h + 1, std::memory_order_release);
+  records++;
+}
+
+void Tracer::writeLoop() {
+  std::vector<uint8_t> out;
+  out.reserve(1 << 17);
+  uint8_t prev[TraceRecord::size] = {};
+  uint8_t cur[TraceRecord::size];
+
+  auto flush = [&] {
+    ok = fwrite(out.data(), 1, out.size(), file) == out.size() && ok;
+    bytes += out.size();
+    out.clear();
+  };
+
+  for (;;) {
+    // Checked before head: once stopping is seen, head is final
+    bool stopping = !running.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (t == h) {
+      if (stopping) {
+        break;
+      }
+      flush();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    for (; t != h; ++t) {
+      ring[t & mask].toBytes(cur);
+      encode(cur, prev, out);
+      if (out.size() >= (1 << 16)) {
+        // Free the slots before the slow part
+        tail.store(t + 1, std::memory_order_release);
+        flush();
+      }
+    }
+    tail.store(t, std::memory_order_release);
+  }
+  flush();
+}
@@ -0,0 +1,83 @@
+#ifndef trace_h
+#define trace_h
+#include "./emu.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+/* CPU state before one instruction, and the cycles the instruction took.
+ * 16 bytes, stored little endian.
+ */
+struct TraceRecord {
+  uint16_t pc = 0, sp = 0;
+  uint8_t op = 0;
+  uint8_t A = 0, B = 0, C = 0, D = 0, E = 0, H = 0, L = 0;
+  uint8_t psw = 0;
+  uint8_t cycles = 0;
+  uint8_t interrupts = 0;
+  uint8_t reserved = 0;
+
+  static constexpr size_t size = 16;
+  void toBytes(uint8_t *b) const;
+  void fromBytes(const uint8_t *b);
+};
+
+/* Trace files: "SITR", u16 version, u16 record size, then one entry per
+ * record: a u16 mask of the bytes that differ from the previous record,
+ * followed by those bytes. Consecutive instructions share most of their
+ * state, so a record usually takes 4-6 bytes.
+ */
+struct TraceReader {
+  ~TraceReader();
+  // False, with the file closed again, if it isn't a trace file
+  bool open(const char *path);
+  bool next(TraceRecord &r);
+
+private:
+  FILE *file = nullptr;
+  uint8_t prev[TraceRecord::size] = {};
+};
+
+/* Records every instruction into a lock-free ring; a background thread
+ * drains it, compresses and writes the file. The emulation thread only
+ * waits if the writer falls a whole ring behind.
+ *
+ * Set it as intel8080::hooks: only the debug core calls it.
+ */
+struct Tracer : CpuHooks {
+  explicit Tracer(size_t capacity = 1 << 16);
+  ~Tracer() override;
+
+  bool open(const char *path);
+  // Drains the ring and closes the file
+  bool close();
+
+  // Called by the debug core around every instruction
+  void before(const intel8080 &cpu) override;
+  void after(const intel8080 &cpu) override;
+
+  uint64_t records = 0;
+  uint64_t waits = 0; // times the ring was full
+  std::atomic<uint64_t> bytes{0};
+
+private:
+  std::vector<TraceRecord> ring;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+
+  FILE *file = nullptr;
+  std::thread writer;
+  std::atomic<bool> running{false};
+  bool ok = true;
+
+  TraceRecord pending;
+  uint32_t startCycles = 0;
+
+  void writeLoop();
+};
+
+#endif /* trace_h */
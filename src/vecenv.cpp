@@ -0,0 +1,213 @@
+#include "./vecenv.h"
+#include "./io.h"
+#include "./observe.h"
+#include "./snapshot.h"
+#include "./vecenv_c.h"
+
+#include <algorithm>
+
+namespace {
+// Game variables in RAM
+namespace ram {
+constexpr uint16_t gameMode = 0x20ef; // 1 while a game is being played
+constexpr uint16_t p1ScoreL = 0x20f8; // BCD, two lowest digits
+constexpr uint16_t p1ScoreM = 0x20f9; // BCD, two highest digits
+} // namespace ram
+
+// Input port bits
+constexpr uint8_t coin = 0b00000001;
+constexpr uint8_t start1 = 0b00000100;
+constexpr uint8_t fire = 0b00010000;
+constexpr uint8_t left = 0b00100000;
+constexpr uint8_t right = 0b01000000;
+constexpr uint8_t read1Default = 0b10000011;
+// Power-on self-test and RAM clear, with no input
+constexpr int bootFrames = 120;
+
+constexpr uint8_t actionBits[VecEnv::ActionCount] = {
+    0, fire, left, right, left | fire, right | fire,
+};
+
+uint32_t bcd(uint8_t b) { return (b >> 4) * 10 + (b & 0xf); }
+
+uint32_t readScore(const Machine &m) {
+  return bcd(m.cpu.read(ram::p1ScoreM)) * 100 +
+         bcd(m.cpu.read(ram::p1ScoreL));
+}
+
+void hold(Machine &m, uint8_t bits, int frames) {
+  m.setInputs(bits, read1Default);
+  for (int i = 0; i < frames; ++i) {
+    m.stepFrame();
+  }
+}
+} // namespace
+
+VecEnv::VecEnv(const Config &config)
+    : config(config), pool(config.threads), machines(config.envs),
+      score(config.envs), episodeFrames(config.envs) {
+  if (this->config.downsample != 2 && this->config.downsample != 4) {
+    this->config.downsample = 1;
+  }
+}
+
+bool VecEnv::loadRom(const char *path) {
+  auto start = std::chrono::steady_clock::now();
+  if (!snapshot.loadRomPath(path)) {
+    return false;
+  }
+  // No sound to drive; every environment is a copy of the snapshot
+  snapshot.cpu.ports = &IoPorts::silent();
+
+  // Boot (or take the booted state from the cache), insert a coin and
+  // press 1P start, then wait for the game to run
+  snapshot.reset();
+  bootState(snapshot, bootFrames)->applyTo(snapshot);
+  hold(snapshot, coin, 4);
+  hold(snapshot, 0, 30);
+  hold(snapshot, start1, 4);
+  for (int i = 0; i < 600 && snapshot.cpu.read(ram::gameMode) != 1; ++i) {
+    hold(snapshot, 0, 1);
+  }
+  snapshotScore = readScore(snapshot);
+  startupSeconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  for (int i = 0; i < config.envs; ++i) {
+    resetOne(i);
+  }
+  return true;
+}
+
+size_t VecEnv::observationSize() const {
+  return observe::size(config.downsample);
+}
+
+int VecEnv::observationRows() const { return observe::rows(config.downsample); }
+
+int VecEnv::observationCols() const { return observe::cols(config.downsample); }
+
+void VecEnv::resetOne(int i) {
+  machines[i] = snapshot;
+  score[i] = snapshotScore;
+  episodeFrames[i] = 0;
+}
+
+void VecEnv::observe(int i, uint8_t *obs) {
+  observe::unpack(machines[i].vram(), config.downsample,
+                  obs + i * observationSize());
+}
+
+void VecEnv::reset(uint8_t *obs) {
+  pool.parallelFor(config.envs, [&](size_t i, size_t) {
+    resetOne(i);
+    observe(i, obs);
+  });
+}
+
+void VecEnv::stepOne(int i, int32_t action, uint8_t *obs, float *reward,
+                     uint8_t *done) {
+  Machine &m = machines[i];
+  uint8_t bits = actionBits[std::min<uint32_t>(action, ActionCount - 1)];
+  m.setInputs(bits, read1Default | bits);
+
+  bool running = true;
+  for (int f = 0; f < config.frameskip && running; ++f) {
+    running = m.stepFrame();
+  }
+  episodeFrames[i] += config.frameskip;
+
+  uint32_t s = readScore(m);
+  reward[i] = s >= score[i] ? static_cast<float>(s - score[i]) : 0.0f;
+  score[i] = s;
+
+  done[i] = !running || m.cpu.read(ram::gameMode) == 0 ||
+            episodeFrames[i] >= config.maxFrames;
+  if (done[i]) {
+    resetOne(i);
+  }
+  observe(i, obs);
+}
+
+void VecEnv::step(const int32_t *actions, uint8_t *obs, float *rewards,
+                  uint8_t *done) {
+  auto start = std::chrono::steady_clock::now();
+
+  // One task per worker, each one owning a contiguous range of machines
+  size_t chunks = std::min<size_t>(pool.size(), config.envs);
+  pool.parallelFor(chunks, [&](size_t c, size_t) {
+    int begin = static_cast<int>(config.envs * c / chunks);
+    int end = static_cast<int>(config.envs * (c + 1) / chunks);
+    for (int i = begin; i < end; ++i) {
+      stepOne(i, actions[i], obs, rewards, done);
+    }
+  });
+
+  stepCount += config.envs;
+  stepSeconds += std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+}
+
+double VecEnv::stepsPerSecondPerCore() const {
+  if (stepSeconds == 0) {
+    return 0;
+  }
+  size_t cores = std::min<size_t>(pool.size(), config.envs);
+  return stepCount / stepSeconds / cores;
+}
+
+// C interface
+
+struct si_vecenv {
+  VecEnv env;
+};
+
+si_vecenv *si_vecenv_create(const char *rom, int envs, int threads,
+                            int downsample, int frameskip) {
+  // Nothing may throw out of here, and a bad size would reach the vectors
+  if (rom == nullptr || envs <= 0 || frameskip <= 0 ||
+      (downsample != 1 && downsample != 2 && downsample != 4)) {
+    return nullptr;
+  }
+  VecEnv::Config config;
+  config.envs = envs;
+  if (threads > 0) {
+    config.threads = threads;
+  }
+  config.downsample = downsample;
+  config.frameskip = frameskip;
+
+  auto *e = new si_vecenv{VecEnv(config)};
+  if (!e->env.loadRom(rom)) {
+    delete e;
+    return nullptr;
+  }
+  return e;
+}
+
+void si_vecenv_destroy(si_vecenv *env) { delete env; }
+
+int si_vecenv_obs_size(const si_vecenv *env) {
+  return static_cast<int>(env->env.observationSize());
+}
+
+int si_vecenv_obs_rows(const si_vecenv *env) {
+  return env->env.observationRows();
+}
+
+int si_vecenv_obs_cols(const si_vecenv *env) {
+  return env->env.observationCols();
+}
+
+void si_vecenv_reset(si_vecenv *env, uint8_t *obs) { env->env.reset(obs); }
+
+void si_vecenv_step(si_vecenv *env, const int32_t *actions, uint8_t *obs,
+                    float *rewards, uint8_t *done) {
+  env->env.step(actions, obs, rewards, done);
+}
+
+double si_vecenv_steps_per_second_per_core(const si_vecenv *env) {
+  return env->env.stepsPerSecondPerCore();
+}
@@ -0,0 +1,75 @@
+#ifndef vecenv_h
+#define vecenv_h
+#include "./machine.h"
+#include "./threadpool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* N independent machines stepped together for reinforcement learning:
+ *   step(actions[N]) -> observations[N], rewards[N], done[N]
+ * Machines are spread over a thread pool. A machine whose game ended is
+ * reset from a snapshot taken right after the game started, so the
+ * observation returned with done = 1 is already the first one of the next
+ * episode.
+ */
+struct VecEnv {
+  enum Action : int32_t {
+    Noop,
+    Fire,
+    Left,
+    Right,
+    LeftFire,
+    RightFire,
+    ActionCount
+  };
+
+  struct Config {
+    int envs = 8;
+    size_t threads = std::thread::hardware_concurrency();
+    int downsample = 2;         // 1, 2 or 4 (see observe.h)
+    int frameskip = 4;          // frames an action is held for
+    uint32_t maxFrames = 108000; // truncate episodes after 30 minutes
+  };
+
+  explicit VecEnv(const Config &config);
+
+  // Load the ROM and build the post-boot snapshot
+  bool loadRom(const char *path);
+  // Time loadRom took to get to the first playable frame
+  double startupSeconds = 0;
+
+  size_t observationSize() const;
+  int observationRows() const;
+  int observationCols() const;
+
+  // Reset every machine. obs holds envs * observationSize() bytes.
+  void reset(uint8_t *obs);
+  void step(const int32_t *actions, uint8_t *obs, float *rewards,
+            uint8_t *done);
+
+  // Throughput of step() so far
+  uint64_t steps() const { return stepCount; }
+  double stepsPerSecondPerCore() const;
+
+private:
+  Config config;
+  ThreadPool pool;
+  Machine snapshot;
+  uint32_t snapshotScore = 0;
+  std::vector<Machine> machines;
+  std::vector<uint32_t> score;
+  std::vector<uint32_t> episodeFrames;
+
+  uint64_t stepCount = 0;
+  double stepSeconds = 0;
+
+  void stepOne(int i, int32_t action, uint8_t *obs, float *reward,
+               uint8_t *done);
+  void resetOne(int i);
+  void observe(int i, uint8_t *obs);
+};
+
+#endif /* vecenv_h */
@@ -0,0 +1,34 @@
+#ifndef vecenv_c_h
+#define vecenv_c_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* C interface to VecEnv (see vecenv.h) */
+typedef struct si_vecenv si_vecenv;
+
+/* Returns NULL if the ROM can't be loaded, envs or frameskip isn't
+ * positive, or downsample isn't 1, 2 or 4. threads = 0 uses every core. */
+si_vecenv *si_vecenv_create(const char *rom, int envs, int threads,
+                            int downsample, int frameskip);
+void si_vecenv_destroy(si_vecenv *env);
+
+/* Bytes per observation, rows and columns of one observation */
+int si_vecenv_obs_size(const si_vecenv *env);
+int si_vecenv_obs_rows(const si_vecenv *env);
+int si_vecenv_obs_cols(const si_vecenv *env);
+
+void si_vecenv_reset(si_vecenv *env, uint8_t *obs);
+void si_vecenv_step(si_vecenv *env, const int32_t *actions, uint8_t *obs,
+                    float *rewards, uint8_t *done);
+
+double si_vecenv_steps_per_second_per_core(const si_vecenv *env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* vecenv_c_h */
@@ -0,0 +1,122 @@
+#include "./wav.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+template <typename T> bool writeLE(FILE *f, T v) {
+  uint8_t buf[sizeof(T)];
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buf[i] = (v >> (8 * i)) & 0xff;
+  }
+  return fwrite(buf, 1, sizeof(T), f) == sizeof(T);
+}
+} // namespace
+
+bool wav::load(const char *path, int rate, std::vector<int16_t> &samples) {
+  FILE *f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> file;
+  uint8_t buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+    file.insert(file.end(), buf, buf + n);
+  }
+  fclose(f);
+
+  if (file.size() < 12 || memcmp(file.data(), "RIFF", 4) != 0 ||
+      memcmp(file.data() + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  // Walk the chunks for "fmt " and "data"
+  uint16_t format = 0, channels = 0, bits = 0;
+  uint32_t fileRate = 0;
+  const uint8_t *data = nullptr;
+  size_t dataSize = 0;
+  for (size_t pos = 12; pos + 8 <= file.size();) {
+    const uint8_t *chunk = file.data() + pos;
+    size_t size = le32(chunk + 4);
+    size = std::min(size, file.size() - pos - 8);
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+      format = le16(chunk + 8);
+      channels = le16(chunk + 10);
+      fileRate = le32(chunk + 12);
+      bits = le16(chunk + 22);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      data = chunk + 8;
+      dataSize = size;
+    }
+    pos += 8 + size + (size & 1);
+  }
+  if (format != 1 || channels == 0 || fileRate == 0 || data == nullptr ||
+      (bits != 8 && bits != 16)) {
+    return false;
+  }
+
+  // First channel only, nearest neighbour resampling
+  size_t frameBytes = channels * bits / 8;
+  size_t frames = dataSize / frameBytes;
+  size_t out = frames * rate / fileRate;
+  samples.resize(out);
+  for (size_t i = 0; i < out; ++i) {
+    const uint8_t *s = data + (i * fileRate / rate) * frameBytes;
+    samples[i] = bits == 8 ? static_cast<int16_t>((s[0] - 128) << 8)
+                           : static_cast<int16_t>(le16(s));
+  }
+  return true;
+}
+
+WavWriter::~WavWriter() { close(); }
+
+bool WavWriter::open(const char *path, int rate) {
+  close();
+  file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  samples = 0;
+
+  // Sizes are patched in close()
+  fwrite("RIFF", 1, 4, file);
+  writeLE<uint32_t>(file, 0);
+  fwrite("WAVEfmt ", 1, 8, file);
+  writeLE<uint32_t>(file, 16);
+  writeLE<uint16_t>(file, 1); // PCM
+  writeLE<uint16_t>(file, 1); // mono
+  writeLE<uint32_t>(file, rate);
+  writeLE<uint32_t>(file, rate * 2);
+  writeLE<uint16_t>(file, 2);
+  writeLE<uint16_t>(file, 16);
+  fwrite("data", 1, 4, file);
+  return writeLE<uint32_t>(file, 0);
+}
+
+void WavWriter::write(const int16_t *s, size_t n) {
+  if (file == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    writeLE(file, static_cast<uint16_t>(s[i]));
+  }
+  samples += n;
+}
+
+bool WavWriter::close() {
+  if (file == nullptr) {
+    return false;
+  }
+  auto bytes = static_cast<uint32_t>(samples * 2);
+  bool ok = fseek(file, 4, SEEK_SET) == 0 && writeLE(file, 36 + bytes) &&
+            fseek(file, 40, SEEK_SET) == 0 && writeLE(file, bytes);
+  ok = fclose(file) == 0 && ok;
+  file = nullptr;
+  return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef wav_h
+#define wav_h
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace wav {
+// Reads a PCM .wav file (8 or 16 bit, any channel count) as mono 16 bit
+// samples resampled to rate. Returns false if it can't be read.
+bool load(const char *path, int rate, std::vector<int16_t> &samples);
+} // namespace wav
+
+/* Streams mono 16 bit samples to a .wav file. The header sizes are filled
+ * in by close().
+ */
+struct WavWriter {
+  ~WavWriter();
+
+  bool open(const char *path, int rate);
+  void write(const int16_t *samples, size_t n);
+  bool close();
+
+  uint64_t samples = 0;
+
+private:
+  FILE *file = nullptr;
+};
+
+#endif /* wav_h */
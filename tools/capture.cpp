@@ -0,0 +1,165 @@
+// Records a movie's replay with VideoCapture (src/capture.h) and reports
+// what capture costs the emulation thread, the size of the stream and,
+// with --check, whether every frame and a few seeks decode to the screen
+// the machine had.
+//
+//   capture --rom invaders.zip --movie m.simv --out run.sicv
+//           [--y4m run.y4m] [--keyframes N] [--queue N] [--check]
+//
+// The replay runs flat out, much faster than the encoder on a busy core:
+// raise --queue for --check, which needs every frame.
+
+#include "../src/capture.h"
+#include "../src/io.h"
+#include "../src/movie.h"
+#include "./common.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+namespace {
+// CPU time of this thread: what the emulation thread pays, without the
+// time other threads (the encoder) had the core
+double threadSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Replays the movie, calling each(m) after every frame. Returns the CPU
+// time the replay took on this thread.
+template <typename F>
+double replay(const Machine &base, const Movie &movie, F each) {
+  Machine m = base;
+  m.reset();
+  double start = threadSeconds();
+  for (const auto &in : movie.inputs) {
+    m.setInputs(in[0], in[1]);
+    m.stepFrame();
+    each(m);
+  }
+  return threadSeconds() - start;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *moviePath = nullptr, *out = nullptr;
+  VideoCapture::Config config;
+  bool check = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--check")) {
+      check = true;
+    } else if (i + 1 == argc) {
+      break;
+    } else if (!strcmp(argv[i], "--rom")) {
+      rom = argv[++i];
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[++i];
+    } else if (!strcmp(argv[i], "--out")) {
+      out = argv[++i];
+    } else if (!strcmp(argv[i], "--y4m")) {
+      config.y4mPath = argv[++i];
+    } else if (!strcmp(argv[i], "--keyframes")) {
+      config.keyframeInterval = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--queue")) {
+      config.queueFrames = strtoul(argv[++i], nullptr, 10);
+    }
+  }
+  if (rom == nullptr || moviePath == nullptr || out == nullptr) {
+    fprintf(stderr, "usage: capture --rom <zip|dir> --movie m.simv --out "
+                    "run.sicv\n"
+                    "               [--y4m run.y4m] [--keyframes N] "
+                    "[--queue N] [--check]\n");
+    return 2;
+  }
+
+  Machine base;
+  if (!base.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  base.cpu.ports = &IoPorts::silent();
+  Movie movie;
+  if (!movie.load(moviePath) || movie.inputs.empty()) {
+    fprintf(stderr, "cannot read %s\n", moviePath);
+    return 2;
+  }
+
+  // The same replay without capture, best of three, against one with it
+  double plain = 1e9;
+  for (int i = 0; i < 3; ++i) {
+    plain = std::min(plain, replay(base, movie, [](const Machine &) {}));
+  }
+  VideoCapture capture;
+  if (!capture.start(out, config)) {
+    fprintf(stderr, "cannot write %s\n", out);
+    return 1;
+  }
+  double capturing =
+      replay(base, movie, [&](const Machine &m) { capture.push(m); });
+  auto t = Clock::now();
+  if (!capture.stop()) {
+    fprintf(stderr, "writing %s failed\n", out);
+    return 1;
+  }
+  double draining = since(t);
+
+  size_t raw = capture.frames * VideoCapture::frameBytes;
+  printf("%llu frames, %llu keyframes, %llu dropped\n",
+         static_cast<unsigned long long>(capture.frames),
+         static_cast<unsigned long long>(capture.keyframes),
+         static_cast<unsigned long long>(capture.dropped));
+  printf("%llu bytes, %.1f per frame, %.1fx smaller than raw VRAM\n",
+         static_cast<unsigned long long>(capture.bytes),
+         double(capture.bytes) / capture.frames,
+         double(raw) / capture.bytes);
+  printf("emulation thread %.2f%% slower with capture (%.2f us a frame), "
+         "%.3f s to drain at stop\n",
+         100 * (capturing - plain) / plain,
+         1e6 * (capturing - plain) / movie.inputs.size(), draining);
+
+  if (!check) {
+    return 0;
+  }
+  if (capture.dropped != 0) {
+    printf("frames were dropped: nothing to compare\n");
+    return 1;
+  }
+  VideoReader reader;
+  if (!reader.open(out) || reader.frames() != movie.inputs.size()) {
+    fprintf(stderr, "cannot read %s back\n", out);
+    return 1;
+  }
+
+  // Every frame in order, then from random frames on
+  std::vector<std::vector<uint8_t>> screens;
+  replay(base, movie, [&](const Machine &m) {
+    screens.emplace_back(m.vram(), m.vram() + VideoCapture::frameBytes);
+  });
+  std::vector<uint8_t> frame(VideoCapture::frameBytes);
+  for (size_t i = 0; i < screens.size(); ++i) {
+    if (!reader.read(frame.data()) || frame != screens[i]) {
+      printf("frame %zu differs\n", i);
+      return 1;
+    }
+  }
+  std::mt19937 rng(1);
+  for (int i = 0; i < 20; ++i) {
+    uint32_t n = rng() % screens.size();
+    if (!reader.seek(n) || !reader.read(frame.data()) ||
+        frame != screens[n]) {
+      printf("seek to frame %u differs\n", n);
+      return 1;
+    }
+  }
+  printf("%zu frames and 20 seeks decode to the screens replayed\n",
+         screens.size());
+  return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef common_h
+#define common_h
+#include "../src/machine.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+/* Shared by the tools: wall clock timing, random player inputs and the
+ * frame by frame comparison the *_check tools make between a faster way
+ * of running the ROM and the interpreter.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+// Seconds since t
+inline double since(Clock::time_point t) {
+  return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+// Buttons held like a player would: a new random set about every eighth
+// frame
+struct RandomInputs {
+  explicit RandomInputs(unsigned seed) : rng(seed) {}
+
+  uint8_t next() {
+    if (rng() % 8 == 0) {
+      held = rng() & 0b01110101;
+    }
+    return held;
+  }
+  // Port 1, and port 2 with the DIP switches the tools always use
+  static void apply(Machine &m, uint8_t held) {
+    m.setInputs(held, 0b10000011 | held);
+  }
+
+  std::mt19937 rng;
+  uint8_t held = 0;
+};
+
+/* Runs the machines under test and plain Machines side by side, lane by
+ * lane, each lane on its own random inputs, and compares the state hash,
+ * the instructions and the interrupts of every lane after every frame.
+ * Only step() differs between the checks: it runs one frame of every
+ * machine under test.
+ */
+struct Differential {
+  std::vector<Machine *> test, reference;
+  // False if a half frame stalled on any lane
+  std::function<bool()> step;
+  // Printed before a difference
+  const char *label = "";
+
+  double testTime = 0, referenceTime = 0;
+
+  // Returns false after printing the first difference
+  bool run(int frames, unsigned seed) {
+    std::vector<RandomInputs> inputs;
+    for (size_t i = 0; i < test.size(); ++i) {
+      inputs.emplace_back(seed + static_cast<unsigned>(i));
+    }
+    for (int f = 0; f < frames; ++f) {
+      for (size_t i = 0; i < test.size(); ++i) {
+        uint8_t held = inputs[i].next();
+        RandomInputs::apply(*test[i], held);
+        RandomInputs::apply(*reference[i], held);
+      }
+
+      auto t = Clock::now();
+      bool a = step();
+      testTime += since(t);
+      t = Clock::now();
+      bool b = true;
+      for (Machine *m : reference) {
+        b = m->stepFrame() && b;
+      }
+      referenceTime += since(t);
+
+      for (size_t i = 0; i < test.size(); ++i) {
+        if (!same(*test[i], *reference[i], a == b, i, f)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  bool same(Machine &x, Machine &y, bool sameResult, size_t lane, int f) {
+    char where[32] = "";
+    if (test.size() > 1) {
+      snprintf(where, sizeof(where), "lane %zu ", lane);
+    }
+    uint64_t hx = x.stateHash(), hy = y.stateHash();
+    if (!sameResult || hx != hy) {
+      printf("%s%s%sdiffers after frame %d: %016llx vs %016llx\n", label,
+             *label != '\0' ? " " : "", where, f,
+             static_cast<unsigned long long>(hx),
+             static_cast<unsigned long long>(hy));
+      return false;
+    }
+    if (x.instructions != y.instructions ||
+        x.interruptsDelivered != y.interruptsDelivered) {
+      printf("%s%s%scounters differ after frame %d: %llu instructions and "
+             "%llu interrupts vs %llu and %llu\n",
+             label, *label != '\0' ? " " : "", where, f,
+             static_cast<unsigned long long>(x.instructions),
+             static_cast<unsigned long long>(x.interruptsDelivered),
+             static_cast<unsigned long long>(y.instructions),
+             static_cast<unsigned long long>(y.interruptsDelivered));
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif /* common_h */
@@ -0,0 +1,205 @@
+// Runs CP/M 8080 diagnostics (TST8080.COM, CPUDIAG.COM, 8080PRE.COM,
+// 8080EXM.COM...) on the intel8080 core and reports pass/fail and speed.
+//
+//   cpm_test [--max N] [--quiet] program.com ...
+//
+// The program is loaded at 0x100 in a flat 64 KB of RAM. BDOS calls
+// (CALL 5) 2 (print the character in E) and 9 (print the string at DE up
+// to '$') go to stdout; jumping to 0 (warm boot) ends the run. A run
+// passes if it ends that way without printing "ERROR" or "FAIL". It fails
+// if it hits an opcode the core doesn't implement, prints a string with no
+// '$' anywhere in memory, or runs --max instructions.
+
+#include "../src/disasm.h"
+#include "../src/emu.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr uint16_t bdos = 0x0005;
+constexpr uint16_t bdosImpl = 0xfe00; // where BDOS "lives", just a RET
+constexpr uint16_t tpa = 0x0100;
+
+enum class Outcome {
+  Passed,
+  Failed,
+  Unimplemented,
+  Unterminated,
+  Limit,
+  BadFile
+};
+
+struct Run {
+  Outcome outcome = Outcome::BadFile;
+  uint64_t instructions = 0;
+  uint64_t cycles = 0;
+  double seconds = 0;
+  std::string output;
+  uint16_t pc = 0;
+  uint8_t op = 0;
+};
+
+bool load(intel8080 &cpu, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == nullptr) {
+    return false;
+  }
+  cpu.mapFlat();
+  size_t n = fread(cpu.ram.data() + tpa, 1, cpu.ram.size() - tpa, f);
+  fclose(f);
+  if (n == 0) {
+    return false;
+  }
+
+  // 0x0005: JMP BDOS; programs also read the top of memory from 0x0006
+  cpu.write(bdos, 0xc3);
+  cpu.write(bdos + 1, bdosImpl & 0xff);
+  cpu.write(bdos + 2, bdosImpl >> 8);
+  cpu.write(bdosImpl, 0xc9);
+
+  cpu.pc = tpa;
+  cpu.sp = bdosImpl;
+  cpu.A = cpu.B = cpu.C = cpu.D = cpu.E = cpu.H = cpu.L = 0;
+  cpu.f = {};
+  cpu.cycles = 0;
+  cpu.interrupts = false;
+  cpu.unimplemented = 0;
+  return true;
+}
+
+// False if a string to print has no '$' in the whole 64 KB
+bool bdosCall(intel8080 &cpu, std::string &out, bool quiet) {
+  size_t from = out.size();
+  bool ended = true;
+  if (cpu.C == 2) {
+    out += static_cast<char>(cpu.E);
+  } else if (cpu.C == 9) {
+    uint32_t n = 0;
+    for (; n < 0x10000 && cpu.read(cpu.DE + n) != '$'; ++n) {
+      out += static_cast<char>(cpu.read(cpu.DE + n));
+    }
+    ended = n < 0x10000;
+  }
+  if (!quiet) {
+    fwrite(out.data() + from, 1, out.size() - from, stdout);
+    fflush(stdout);
+  }
+  return ended;
+}
+
+Run run(const char *path, uint64_t max, bool quiet) {
+  Run r;
+  intel8080 cpu;
+  if (!load(cpu, path)) {
+    return r;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  r.outcome = Outcome::Limit;
+  while (r.instructions < max) {
+    if (cpu.pc == 0) {
+      bool failed = r.output.find("ERROR") != std::string::npos ||
+                    r.output.find("FAIL") != std::string::npos;
+      r.outcome = failed ? Outcome::Failed : Outcome::Passed;
+      break;
+    }
+    if (cpu.pc == bdos && !bdosCall(cpu, r.output, quiet)) {
+      r.pc = cpu.DE;
+      r.outcome = Outcome::Unterminated;
+      break;
+    }
+
+    r.pc = cpu.pc;
+    cpu.emulateCycle();
+    r.instructions++;
+    if (cpu.unimplemented != 0) {
+      r.op = cpu.lastUnimplemented;
+      r.outcome = Outcome::Unimplemented;
+      break;
+    }
+    // cycles is 32 bits and wraps every half hour of 8080 time
+    if (cpu.cycles >= 0x80000000u) {
+      r.cycles += cpu.cycles;
+      cpu.cycles = 0;
+    }
+  }
+  r.cycles += cpu.cycles;
+  r.seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  return r;
+}
+
+const char *outcomeName(Outcome o) {
+  switch (o) {
+  case Outcome::Passed:
+    return "PASS";
+  case Outcome::Failed:
+    return "FAIL";
+  case Outcome::Unimplemented:
+    return "UNIMPLEMENTED";
+  case Outcome::Unterminated:
+    return "UNTERMINATED";
+  case Outcome::Limit:
+    return "LIMIT";
+  default:
+    return "UNREADABLE";
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t max = ~0ull;
+  bool quiet = false;
+  std::vector<const char *> programs;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--max") && i + 1 < argc) {
+      max = strtoull(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--quiet")) {
+      quiet = true;
+    } else if (argv[i][0] != '-') {
+      programs.push_back(argv[i]);
+    } else {
+      programs.clear();
+      break;
+    }
+  }
+  if (programs.empty()) {
+    fprintf(stderr, "usage: cpm_test [--max N] [--quiet] program.com ...\n");
+    return 2;
+  }
+
+  int failures = 0;
+  for (const char *path : programs) {
+    if (!quiet) {
+      printf("== %s\n", path);
+    }
+    Run r = run(path, max, quiet);
+    if (!quiet) {
+      printf("\n");
+    }
+
+    printf("%-14s %s: %llu instructions, %llu cycles in %.2f s, "
+           "%.1f M instructions/s",
+           outcomeName(r.outcome), path,
+           static_cast<unsigned long long>(r.instructions),
+           static_cast<unsigned long long>(r.cycles), r.seconds,
+           r.seconds > 0 ? r.instructions / r.seconds / 1e6 : 0.0);
+    if (r.outcome == Outcome::Unimplemented) {
+      printf(", opcode %02x (%s) at %04x", r.op, disasm::opcode(r.op).format,
+             r.pc);
+    } else if (r.outcome == Outcome::Unterminated) {
+      printf(", no '$' after the BDOS 9 string at %04x", r.pc);
+    }
+    printf("\n");
+    fflush(stdout);
+    failures += r.outcome != Outcome::Passed;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+// Line debugger for the emulated program: commands on stdin, one per line,
+// addresses, values and lengths in hex, counts and frames in decimal.
+//
+//   debug --rom invaders.zip
+//
+//   b ADR / d ADR      set / delete a breakpoint
+//   w ADR [LEN]        stop after writes to ADR..ADR+LEN-1
+//   r ADR [LEN]        stop after reads of them
+//   in PORT / out PORT stop after IN / OUT on a port
+//   clear              delete all of the above
+//   s [N]              step N instructions
+//   n                  step over CALL, Ccc and RST
+//   f                  run until the current routine returns
+//   c [FRAMES]         continue, at most FRAMES frames (default 3600)
+//   regs               registers and the next instruction
+//   x ADR [LEN]        dump memory
+//   l [ADR] [N]        disassemble N instructions from ADR (default pc)
+//   input R0 R1        set the input ports
+//   q                  quit
+
+#include "../src/debugger.h"
+#include "../src/disasm.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+// Argument i of the line, or def when missing
+unsigned long arg(char **args, int n, int i, unsigned long def, int base) {
+  return i < n ? strtoul(args[i], nullptr, base) : def;
+}
+
+void printRegs(const intel8080 &cpu) {
+  printf("pc=%04x sp=%04x a=%02x b=%02x c=%02x d=%02x e=%02x h=%02x l=%02x "
+         "%c%c%c%c %s  %s\n",
+         cpu.pc, cpu.sp, cpu.A, cpu.B, cpu.C, cpu.D, cpu.E, cpu.H, cpu.L,
+         cpu.f.S ? 'S' : '-', cpu.f.Z ? 'Z' : '-', cpu.f.P ? 'P' : '-',
+         cpu.f.CY ? 'C' : '-', cpu.interrupts ? "EI" : "DI",
+         disasm::format(cpu, cpu.pc).c_str());
+}
+
+void printStop(const Debugger &dbg, Debugger::Stop s, const intel8080 &cpu) {
+  switch (s) {
+  case Debugger::Stop::Read:
+  case Debugger::Stop::Write:
+    printf("%s %04x = %02x\n", stopName(s), dbg.stopAdr, dbg.stopValue);
+    break;
+  case Debugger::Stop::In:
+  case Debugger::Stop::Out:
+    printf("%s port %u, a=%02x\n", stopName(s), dbg.stopAdr, cpu.A);
+    break;
+  case Debugger::Stop::Step:
+    break;
+  default:
+    printf("%s\n", stopName(s));
+    break;
+  }
+  printRegs(cpu);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    }
+  }
+  if (rom == nullptr) {
+    fprintf(stderr, "usage: debug --rom <zip|dir>\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  m.reset();
+  Debugger dbg(m);
+  printRegs(m.cpu);
+
+  char line[256];
+  for (;;) {
+    printf("> ");
+    fflush(stdout);
+    if (fgets(line, sizeof(line), stdin) == nullptr) {
+      break;
+    }
+    char *args[4];
+    int n = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok != nullptr && n < 4;
+         tok = strtok(nullptr, " \t\r\n")) {
+      args[n++] = tok;
+    }
+    if (n == 0) {
+      continue;
+    }
+    std::string cmd = args[0];
+    auto a = [&](int i, unsigned long def) { return arg(args, n, i, def, 16); };
+    auto count = [&](int i, unsigned long def) {
+      return arg(args, n, i, def, 10);
+    };
+
+    if (cmd == "q") {
+      break;
+    } else if ((cmd == "b" || cmd == "d") && n > 1) {
+      dbg.breakpoints[a(1, 0) & 0xffff] = cmd == "b";
+    } else if ((cmd == "w" || cmd == "r") && n > 1) {
+      auto &watch = cmd == "w" ? dbg.writeWatch : dbg.readWatch;
+      for (unsigned long i = 0, adr = a(1, 0); i < a(2, 1); ++i) {
+        watch[(adr + i) & 0xffff] = true;
+      }
+    } else if (cmd == "in" && n > 1) {
+      dbg.inBreak[a(1, 0) & 0xff] = true;
+    } else if (cmd == "out" && n > 1) {
+      dbg.outBreak[a(1, 0) & 0xff] = true;
+    } else if (cmd == "clear") {
+      dbg.clear();
+    } else if (cmd == "s") {
+      Debugger::Stop s = Debugger::Stop::Step;
+      for (unsigned long i = count(1, 1); i > 0 && s == Debugger::Stop::Step;
+           --i) {
+        s = dbg.step();
+      }
+      printStop(dbg, s, m.cpu);
+    } else if (cmd == "n") {
+      printStop(dbg, dbg.stepOver(3600), m.cpu);
+    } else if (cmd == "f") {
+      printStop(dbg, dbg.finish(3600), m.cpu);
+    } else if (cmd == "c") {
+      printStop(dbg, dbg.run(count(1, 3600)), m.cpu);
+    } else if (cmd == "regs") {
+      printRegs(m.cpu);
+    } else if (cmd == "x" && n > 1) {
+      unsigned long adr = a(1, 0), len = a(2, 0x40);
+      for (unsigned long i = 0; i < len; ++i) {
+        if (i % 16 == 0) {
+          printf("%s%04lx:", i ? "\n" : "", (adr + i) & 0xffff);
+        }
+        printf(" %02x", m.cpu.read((adr + i) & 0xffff));
+      }
+      printf("\n");
+    } else if (cmd == "l") {
+      uint16_t adr = a(1, m.cpu.pc) & 0xffff;
+      for (unsigned long i = count(2, 10); i > 0; --i) {
+        printf("%04x  %s\n", adr, disasm::format(m.cpu, adr).c_str());
+        adr += disasm::opcode(m.cpu.read(adr)).length;
+      }
+    } else if (cmd == "input" && n > 2) {
+      m.setInputs(a(1, 0) & 0xff, a(2, 0) & 0xff);
+    } else {
+      printf("?\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+// Publishes frames to a shared-memory FrameRing (src/frame_ring.h) from a
+// headless machine, or watches one from another process.
+//
+//   frame_ring --rom invaders.zip --name /si-frames [--format vram|unpacked]
+//              [--slots N] [--frames N] [--fps F] [--movie m.simv]
+//   frame_ring --watch /si-frames [--seconds S]
+//
+// The writer plays the movie's inputs (none without --movie) for --frames
+// frames, at --fps frames per second or as fast as it can with --fps 0,
+// and reports the rate. The watcher reads the newest frame over and over
+// and reports the frames it got, skipped and saw overwritten while
+// reading. It stops after --seconds, or when no frame came for a second.
+
+#include "../src/frame_ring.h"
+#include "../src/io.h"
+#include "../src/movie.h"
+#include "./common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+int publish(const char *rom, const char *name, FrameRing::Format format,
+            int slots, long frames, double fps, const char *moviePath) {
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  m.cpu.ports = &IoPorts::silent();
+  Movie movie;
+  if (moviePath != nullptr && !movie.load(moviePath)) {
+    fprintf(stderr, "cannot read %s\n", moviePath);
+    return 2;
+  }
+  FrameRing ring;
+  if (!ring.create(name, format, slots)) {
+    fprintf(stderr, "cannot create %s\n", name);
+    return 1;
+  }
+
+  auto start = Clock::now();
+  for (long f = 0; f < frames; ++f) {
+    if (f < static_cast<long>(movie.inputs.size())) {
+      m.setInputs(movie.inputs[f][0], movie.inputs[f][1]);
+    }
+    m.stepFrame();
+    ring.publish(m);
+    if (fps > 0) {
+      std::this_thread::sleep_until(
+          start + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>((f + 1) / fps)));
+    }
+  }
+  double t = since(start);
+  printf("published %ld frames of %zu bytes in %.2f s, %.0f frames/s\n",
+         frames, ring.frameBytes(), t, frames / t);
+  return 0;
+}
+
+int watch(const char *name, double seconds) {
+  FrameRing ring;
+  auto start = Clock::now();
+  while (!ring.open(name)) {
+    if (since(start) > 1) {
+      fprintf(stderr, "no ring named %s\n", name);
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  uint64_t got = 0, skipped = 0, torn = 0, next = 0, lastFrame = 0;
+  uint32_t sum = 0;
+  auto lastNew = Clock::now();
+  while (since(lastNew) < 1 && (seconds <= 0 || since(start) < seconds)) {
+    FrameRing::View v;
+    if (!ring.latest(&v) || (got > 0 && v.number < next)) {
+      std::this_thread::yield();
+      continue;
+    }
+    // Use the frame where it is, then check it wasn't overwritten meanwhile
+    for (size_t i = 0; i < v.size; ++i) {
+      sum += v.data[i];
+    }
+    if (!ring.stillValid(v)) {
+      torn++;
+      continue;
+    }
+    skipped += got > 0 ? v.number - next : 0;
+    next = v.number + 1;
+    lastFrame = v.info.frame;
+    got++;
+    lastNew = Clock::now();
+  }
+  printf("read %llu frames, skipped %llu, %llu overwritten while read, "
+         "last frame %llu (checksum %08x)\n",
+         static_cast<unsigned long long>(got),
+         static_cast<unsigned long long>(skipped),
+         static_cast<unsigned long long>(torn),
+         static_cast<unsigned long long>(lastFrame), sum);
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *name = nullptr, *watched = nullptr;
+  const char *moviePath = nullptr;
+  FrameRing::Format format = FrameRing::Vram;
+  int slots = 8;
+  long frames = 3600;
+  double fps = 60, seconds = 0;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--name")) {
+      name = argv[i + 1];
+    } else if (!strcmp(argv[i], "--watch")) {
+      watched = argv[i + 1];
+    } else if (!strcmp(argv[i], "--format")) {
+      format = !strcmp(argv[i + 1], "unpacked") ? FrameRing::Unpacked
+                                                : FrameRing::Vram;
+    } else if (!strcmp(argv[i], "--slots")) {
+      slots = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = atol(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--fps")) {
+      fps = atof(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seconds")) {
+      seconds = atof(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    }
+  }
+
+  if (watched != nullptr) {
+    return watch(watched, seconds);
+  }
+  if (rom == nullptr || name == nullptr || slots < 1 || slots > 0xffff) {
+    fprintf(stderr,
+            "usage: frame_ring --rom <zip|dir> --name /<name> "
+            "[--format vram|unpacked]\n"
+            "                  [--slots N] [--frames N] [--fps F] "
+            "[--movie m.simv]\n"
+            "       frame_ring --watch /<name> [--seconds S]\n");
+    return 2;
+  }
+  return publish(rom, name, format, slots, frames, fps, moviePath);
+}
@@ -0,0 +1,161 @@
+// Fuzzes the core: every run starts from the same booted state, gets
+// random inputs (--mode inputs) or random code, registers and stack
+// pointer in RAM (--mode code), and is undone by restoring only the RAM
+// pages it wrote. Reports runs, resets and emulated cycles per second and
+// the runs that stalled or hit unimplemented opcodes. A run that crashes
+// the process prints its seed, and --seed S --runs 1 replays it.
+//
+//   fuzz --rom invaders.zip [--mode inputs|code] [--runs N] [--frames F]
+//        [--seed S] [--check]
+//
+// --check compares the state hash after every reset with the booted one.
+
+#include "../src/machine.h"
+#include "../src/snapshot.h"
+#include "./common.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+namespace {
+// The run in progress, for the crash handler
+volatile unsigned currentSeed = 0;
+
+void crashed(int sig) {
+  char msg[64];
+  int n = snprintf(msg, sizeof(msg), "\nsignal %d in run with seed %u\n", sig,
+                   currentSeed);
+  if (write(STDERR_FILENO, msg, n) < 0) {
+  }
+  _exit(3);
+}
+
+// Both return false if the CPU stalled
+bool randomInputs(Machine &m, std::mt19937 &rng, int frames) {
+  for (int f = 0; f < frames; ++f) {
+    m.setInputs(rng() & 0xff, rng() & 0xff);
+    if (!m.stepFrame()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Random bytes in one RAM page, random registers and stack, pc in the page
+bool randomCode(Machine &m, std::mt19937 &rng, int frames) {
+  intel8080 &cpu = m.cpu;
+  uint16_t page = cpu.romEnd + (rng() % ((0x10000 - cpu.romEnd) / 256)) * 256;
+  for (int i = 0; i < 256; ++i) {
+    cpu.write(page + i, rng() & 0xff);
+  }
+  cpu.pc = page;
+  cpu.sp = rng() & 0xffff;
+  cpu.BC = rng() & 0xffff;
+  cpu.DE = rng() & 0xffff;
+  cpu.HL = rng() & 0xffff;
+  cpu.A = rng() & 0xff;
+  cpu.f = rng() & 0xff;
+  cpu.interrupts = rng() & 1;
+  for (int f = 0; f < frames; ++f) {
+    if (!m.stepFrame()) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  const char *mode = "inputs";
+  long runs = 10000;
+  int frames = 10;
+  unsigned seed = 1;
+  bool check = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+      rom = argv[++i];
+    } else if (!strcmp(argv[i], "--mode") && i + 1 < argc) {
+      mode = argv[++i];
+    } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      runs = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--check")) {
+      check = true;
+    }
+  }
+  bool code = !strcmp(mode, "code");
+  if (rom == nullptr || (!code && strcmp(mode, "inputs") != 0)) {
+    fprintf(stderr, "usage: fuzz --rom <zip|dir> [--mode inputs|code] "
+                    "[--runs N] [--frames F] [--seed S] [--check]\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  auto booted = bootState(m);
+  booted->applyTo(m);
+  m.cpu.clearDirty();
+  uint64_t bootedHash = m.stateHash();
+
+  signal(SIGSEGV, crashed);
+  signal(SIGBUS, crashed);
+  signal(SIGFPE, crashed);
+  signal(SIGABRT, crashed);
+
+  long stalls = 0, unimplementedRuns = 0, mismatches = 0;
+  uint64_t cycles = 0, pages = 0;
+  double runTime = 0, resetTime = 0;
+  for (long r = 0; r < runs; ++r) {
+    currentSeed = seed + r;
+    std::mt19937 rng(currentSeed);
+
+    auto t = Clock::now();
+    uint64_t before = m.cpu.unimplemented;
+    bool ok = code ? randomCode(m, rng, frames) : randomInputs(m, rng, frames);
+    runTime += since(t);
+
+    cycles += m.totalCycles + m.cpu.cycles - booted->totalCycles -
+              booted->cpu.cycles;
+    stalls += !ok;
+    unimplementedRuns += m.cpu.unimplemented != before;
+    for (uint64_t bits : m.cpu.dirty) {
+      pages += __builtin_popcountll(bits);
+    }
+
+    t = Clock::now();
+    booted->restore(m);
+    resetTime += since(t);
+
+    if (check && m.stateHash() != bootedHash) {
+      printf("seed %u: state differs after the reset\n", currentSeed);
+      mismatches++;
+    }
+  }
+
+  printf("%ld runs of %d frames (%s): %ld stalled, %ld hit unimplemented "
+         "opcodes\n",
+         runs, frames, mode, stalls, unimplementedRuns);
+  printf("%.0f runs/s, %.1f MHz emulated\n", runs / (runTime + resetTime),
+         cycles / runTime / 1e6);
+  printf("%.0f resets/s, %.1f pages of %zu bytes restored per reset\n",
+         runs / resetTime, static_cast<double>(pages) / runs,
+         intel8080::pageSize);
+  if (check) {
+    printf("%ld resets didn't restore the booted state\n", mismatches);
+  }
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+// Profiles the emulated program: hottest addresses and opcodes with their
+// instructions, and folded call stacks for flamegraph.pl or speedscope.
+// Inputs come from a movie, or the machine just runs the attract mode.
+//
+//   profile --rom invaders.zip [--movie m.simv] [--frames N]
+//           [--folded out.folded] [--top N]
+
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/profiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *moviePath = nullptr, *folded = nullptr;
+  uint64_t frames = 3600;
+  size_t top = 30;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = strtoull(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--folded")) {
+      folded = argv[i + 1];
+    } else if (!strcmp(argv[i], "--top")) {
+      top = strtoul(argv[i + 1], nullptr, 10);
+    }
+  }
+  if (rom == nullptr) {
+    fprintf(stderr, "usage: profile --rom <zip|dir> [--movie m.simv] "
+                    "[--frames N] [--folded out.folded] [--top N]\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  Movie movie;
+  if (moviePath != nullptr) {
+    if (!movie.load(moviePath)) {
+      fprintf(stderr, "cannot read %s\n", moviePath);
+      return 2;
+    }
+    frames = movie.inputs.size();
+  }
+
+  // 1 MB of counters, keep it off the stack
+  auto profiler = std::make_unique<Profiler>();
+  m.reset();
+  m.cpu.hooks = profiler.get();
+  for (uint64_t f = 0; f < frames; ++f) {
+    if (moviePath != nullptr) {
+      m.setInputs(movie.inputs[f][0], movie.inputs[f][1]);
+    }
+    m.stepFrame();
+  }
+
+  profiler->writeHot(stdout, m.cpu, top);
+  if (folded != nullptr) {
+    FILE *f = fopen(folded, "w");
+    if (f == nullptr) {
+      fprintf(stderr, "cannot write %s\n", folded);
+      return 2;
+    }
+    profiler->writeFolded(f);
+    fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,260 @@
+// Recompiles the program ROM to C++ ahead of time for StaticInvaders
+// (src/static_invaders.h). Follows the code from the reset vector and the
+// two interrupt vectors, splits it into basic blocks and writes each one as
+// a case of staticcode::run.
+//
+//   recompile --rom invaders.zip --out static_code.cpp [--listing out.txt]
+//             [--entry ADR]...
+//
+// --entry adds more places code starts (hex), such as the targets of PCHL
+// that the analysis can't follow. The output builds with the core and
+// src/static_invaders.cpp.
+
+#include "../src/disasm.h"
+#include "../src/dispatcher.h"
+#include "../src/io.h"
+#include "../src/machine.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+// What an instruction does to the flow of control, as the core runs it
+enum class Flow {
+  Next,
+  Jump,
+  JumpCond,
+  Call,
+  CallCond,
+  Ret,
+  RetCond,
+  Indirect, // PCHL
+  Stuck,    // not implemented: pc stays where it is
+};
+
+Flow flow(uint8_t op) {
+  if (unimplementedOpcodes()[op]) {
+    return Flow::Stuck;
+  }
+  if (op == 0xc3 || op == 0xcb) {
+    return Flow::Jump;
+  }
+  if ((op & 0xc7) == 0xc2) {
+    return Flow::JumpCond;
+  }
+  if (op == 0xcd || op == 0xdd || op == 0xed || op == 0xfd) {
+    return Flow::Call;
+  }
+  if ((op & 0xc7) == 0xc4) {
+    return Flow::CallCond;
+  }
+  if (op == 0xc9 || op == 0xd9) {
+    return Flow::Ret;
+  }
+  // The core runs 0xff as RM; 0xf8 isn't implemented
+  if ((op & 0xc7) == 0xc0 || op == 0xff) {
+    return Flow::RetCond;
+  }
+  if (op == 0xe9) {
+    return Flow::Indirect;
+  }
+  return Flow::Next;
+}
+
+bool endsBlock(Flow f) { return f != Flow::Next; }
+
+struct Analysis {
+  std::vector<bool> start = std::vector<bool>(RomImage::size);
+  std::set<uint16_t> leaders;
+  std::set<uint16_t> indirect; // PCHL sites
+  std::set<uint16_t> stuck;    // unimplemented opcodes
+};
+
+Analysis analyze(const uint8_t *rom, const std::vector<uint16_t> &entries) {
+  Analysis a;
+  std::vector<uint16_t> work(entries.begin(), entries.end());
+  for (uint16_t e : entries) {
+    a.leaders.insert(e);
+  }
+
+  while (!work.empty()) {
+    uint16_t adr = work.back();
+    work.pop_back();
+    for (;;) {
+      if (adr >= RomImage::size || a.start[adr]) {
+        break;
+      }
+      uint8_t op = rom[adr];
+      uint8_t length = disasm::opcode(op).length;
+      if (adr + length > RomImage::size) {
+        break;
+      }
+      a.start[adr] = true;
+
+      Flow f = flow(op);
+      uint16_t next = adr + length;
+      if (f == Flow::Jump || f == Flow::JumpCond || f == Flow::Call ||
+          f == Flow::CallCond) {
+        uint16_t target = rom[adr + 1] | (rom[adr + 2] << 8);
+        if (target < RomImage::size) {
+          a.leaders.insert(target);
+          work.push_back(target);
+        }
+      }
+      if (f == Flow::Indirect) {
+        a.indirect.insert(adr);
+      }
+      if (f == Flow::Stuck) {
+        a.stuck.insert(adr);
+      }
+      if (f == Flow::Jump || f == Flow::Ret || f == Flow::Indirect ||
+          f == Flow::Stuck) {
+        break;
+      }
+      if (endsBlock(f)) {
+        // Where a call returns, or a branch not taken goes
+        a.leaders.insert(next);
+      }
+      adr = next;
+    }
+  }
+  return a;
+}
+
+// The instructions of the block starting at leader
+std::vector<uint16_t> block(const Analysis &a, const uint8_t *rom,
+                            uint16_t leader) {
+  std::vector<uint16_t> out;
+  uint16_t adr = leader;
+  for (;;) {
+    out.push_back(adr);
+    uint8_t op = rom[adr];
+    adr += disasm::opcode(op).length;
+    if (endsBlock(flow(op)) || adr >= RomImage::size ||
+        !a.start[adr] || a.leaders.count(adr) != 0) {
+      return out;
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *out = nullptr, *listing = nullptr;
+  // Reset, then the two interrupts the board raises (RST 1 and RST 2)
+  std::vector<uint16_t> entries = {0x0000, 0x0008, 0x0010};
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--out")) {
+      out = argv[i + 1];
+    } else if (!strcmp(argv[i], "--listing")) {
+      listing = argv[i + 1];
+    } else if (!strcmp(argv[i], "--entry")) {
+      entries.push_back(strtoul(argv[i + 1], nullptr, 16) & 0x1fff);
+    }
+  }
+  if (rom == nullptr || out == nullptr) {
+    fprintf(stderr, "usage: recompile --rom <zip|dir> --out <file.cpp> "
+                    "[--listing out.txt] [--entry ADR]...\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  const uint8_t *bytes = m.rom->data();
+
+  Analysis a = analyze(bytes, entries);
+  std::vector<std::vector<uint16_t>> blocks;
+  size_t instructions = 0, covered = 0;
+  for (uint16_t leader : a.leaders) {
+    if (leader < RomImage::size && a.start[leader]) {
+      blocks.push_back(block(a, bytes, leader));
+      instructions += blocks.back().size();
+    }
+  }
+  for (size_t adr = 0; adr < RomImage::size; ++adr) {
+    if (a.start[adr]) {
+      covered += disasm::opcode(bytes[adr]).length;
+    }
+  }
+
+  FILE *f = fopen(out, "w");
+  if (f == nullptr) {
+    fprintf(stderr, "cannot write %s\n", out);
+    return 2;
+  }
+  fprintf(f,
+          "// Generated by tools/recompile.cpp: %zu blocks, %zu instructions.\n"
+          "// Do not edit.\n\n"
+          "#include \"./dispatcher.h\"\n"
+          "#include \"./static_invaders.h\"\n\n"
+          "namespace staticcode {\n"
+          "const uint64_t romHash = 0x%016llxULL;\n"
+          "const uint32_t blocks = %zu;\n\n"
+          "uint64_t run(intel8080 &cpu, uint32_t start) {\n"
+          "  using P = ProductionFeatures;\n"
+          "  uint64_t done = 0;\n"
+          "  for (;;) {\n"
+          "    switch (cpu.pc) {\n",
+          blocks.size(), instructions,
+          static_cast<unsigned long long>(m.rom->hash()), blocks.size());
+  for (const auto &b : blocks) {
+    fprintf(f, "    case 0x%04x:\n", b.front());
+    for (size_t k = 0; k < b.size(); ++k) {
+      // The interpreter's own case for the opcode, folded by the compiler.
+      // The count of instructions run is known at every exit.
+      fprintf(f, "      cpu.execute<P>(0x%02x); // %s\n", bytes[b[k]],
+              disasm::format(m.cpu, b[k]).c_str());
+      fprintf(f,
+              "      if (StaticInvaders::due(cpu, start)) return done + %zu;\n",
+              k + 1);
+    }
+    fprintf(f, "      done += %zu;\n", b.size());
+    fprintf(f, "      break;\n");
+  }
+  fprintf(f, "    default:\n"
+             "      return done;\n"
+             "    }\n"
+             "  }\n"
+             "}\n"
+             "} // namespace staticcode\n");
+  bool ok = fclose(f) == 0;
+
+  if (listing != nullptr) {
+    FILE *l = fopen(listing, "w");
+    if (l == nullptr) {
+      fprintf(stderr, "cannot write %s\n", listing);
+      return 2;
+    }
+    for (const auto &b : blocks) {
+      fprintf(l, "block_%04x:\n", b.front());
+      for (uint16_t adr : b) {
+        fprintf(l, "  %04x  %s\n", adr, disasm::format(m.cpu, adr).c_str());
+      }
+    }
+    fclose(l);
+  }
+
+  printf("%zu blocks, %zu instructions, %zu of %zu ROM bytes are code\n",
+         blocks.size(), instructions, covered, RomImage::size);
+  for (uint16_t adr : a.indirect) {
+    printf("  PCHL at %04x: targets run on the interpreter unless given "
+           "with --entry\n",
+           adr);
+  }
+  for (uint16_t adr : a.stuck) {
+    printf("  unimplemented opcode %02x at %04x\n", bytes[adr], adr);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// Checks SoftRenderer (src/render.h) against a pixel by pixel model of the
+// GL path: the texture Display::draw uploads, the quad turned by
+// Display::start, nearest sampling at each pixel's centre and the
+// overlay of Display::fragmentSource. Renders the frames of a movie at
+// each scale, with and without overlay and distortion, compares every
+// pixel and reports the time a frame takes. --ppm writes the last frame
+// of the last configuration.
+//
+//   render_check --rom invaders.zip --movie m.simv [--scales 1,2,4]
+//                [--threads T] [--every N] [--ppm out.ppm]
+
+#include "../src/io.h"
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/render.h"
+#include "./common.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// The GL path for the output pixel (px, py) of a width x height window
+void shade(const uint8_t *vram, int width, int height, int px, int py,
+           bool overlay, bool distortion, uint8_t *rgba) {
+  // The quad turned 90 degrees: window up is texture x going down from 1,
+  // window right is texture y
+  float tx = 1.0f - (py + 0.5f) / height, ty = (px + 0.5f) / width;
+  float sx = tx, sy = ty;
+  if (distortion) {
+    float cx = tx - 0.5f, cy = ty - 0.5f;
+    float dist = (cx * cx + cy * cy) * 0.2f;
+    sx = tx + cx * (1.0f - dist) * dist;
+    sy = ty + cy * (1.0f - dist) * dist;
+  }
+
+  // texture(): Display::draw's pixels, clamped to 1 by the upload
+  float texel[4] = {0, 0, 0, 0}; // GL_CLAMP_TO_BORDER
+  int texX = static_cast<int>(std::floor(sx * 256));
+  int texY = static_cast<int>(std::floor(sy * 224));
+  if (texX >= 0 && texX < 256 && texY >= 0 && texY < 224) {
+    int i = texY * 256 + texX;
+    float lit = (vram[i / 8] & (1 << (i % 8))) != 0 ? 1.0f : 0.0f;
+    texel[0] = texel[1] = texel[2] = lit;
+    texel[3] = 1.0f;
+  }
+
+  float x = std::floor(tx * 256), y = std::floor(ty * 224);
+  float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  if (overlay) {
+    if (x > (256 - 65) && x < (256 - 32)) {
+      color[1] = color[2] = 0.0f;
+    } else if (x > 15 && x < (256 - 184)) {
+      color[0] = color[2] = 0.0f;
+    } else if (x < 17 && (y < 122) && (y > 16)) {
+      color[0] = color[2] = 0.0f;
+    }
+  }
+  for (int k = 0; k < 4; ++k) {
+    rgba[k] = static_cast<uint8_t>(std::lround(texel[k] * color[k] * 255));
+  }
+}
+
+bool writePpm(const char *path, const std::vector<uint8_t> &rgba, int w,
+              int h) {
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    return false;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", w, h);
+  for (size_t i = 0; i < rgba.size(); i += 4) {
+    fwrite(&rgba[i], 1, 3, f);
+  }
+  return fclose(f) == 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *moviePath = nullptr, *ppm = nullptr;
+  std::string scales = "1,2,4";
+  size_t threads = std::thread::hardware_concurrency();
+  int every = 60;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    } else if (!strcmp(argv[i], "--scales")) {
+      scales = argv[i + 1];
+    } else if (!strcmp(argv[i], "--threads")) {
+      threads = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--every")) {
+      every = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--ppm")) {
+      ppm = argv[i + 1];
+    }
+  }
+  if (rom == nullptr || moviePath == nullptr || every < 1) {
+    fprintf(stderr,
+            "usage: render_check --rom <zip|dir> --movie m.simv "
+            "[--scales 1,2,4]\n"
+            "                    [--threads T] [--every N] "
+            "[--ppm out.ppm]\n");
+    return 2;
+  }
+
+  Machine m;
+  Movie movie;
+  if (!m.loadRomPath(rom) || !movie.load(moviePath)) {
+    fprintf(stderr, "cannot load %s or %s\n", rom, moviePath);
+    return 2;
+  }
+  m.cpu.ports = &IoPorts::silent();
+
+  // Every Nth frame of the movie
+  std::vector<std::vector<uint8_t>> screens;
+  m.reset();
+  for (size_t f = 0; f < movie.inputs.size(); ++f) {
+    m.setInputs(movie.inputs[f][0], movie.inputs[f][1]);
+    m.stepFrame();
+    if ((f + 1) % every == 0) {
+      screens.emplace_back(m.vram(), m.vram() + 0x1c00);
+    }
+  }
+
+  bool ok = true;
+  std::vector<uint8_t> out, expected(4);
+  for (const char *p = scales.c_str(); *p != '\0';) {
+    int scale = atoi(p);
+    p += strcspn(p, ",");
+    p += *p == ',';
+    for (int variant = 0; variant < 3; ++variant) {
+      SoftRenderer::Config config;
+      config.scale = scale;
+      config.overlay = variant != 1;
+      config.distortion = variant == 2;
+      config.threads = threads;
+      SoftRenderer r(config);
+      out.resize(r.size());
+
+      auto t = Clock::now();
+      for (const auto &screen : screens) {
+        r.render(screen.data(), out.data());
+      }
+      double perFrame = since(t) / screens.size();
+
+      size_t wrong = 0;
+      for (const auto &screen : screens) {
+        r.render(screen.data(), out.data());
+        for (int y = 0; y < r.height(); ++y) {
+          for (int x = 0; x < r.width(); ++x) {
+            shade(screen.data(), r.width(), r.height(), x, y,
+                  config.overlay, config.distortion, expected.data());
+            size_t at = (size_t(y) * r.width() + x) * 4;
+            wrong += memcmp(&out[at], expected.data(), 4) != 0;
+          }
+        }
+      }
+      printf("%4dx%-4d %-10s %-10s %8.1f us/frame, %zu pixels differ\n",
+             r.width(), r.height(), config.overlay ? "overlay" : "plain",
+             config.distortion ? "distorted" : "", perFrame * 1e6, wrong);
+      ok = ok && wrong == 0;
+    }
+  }
+
+  if (ppm != nullptr && !out.empty()) {
+    int scale = static_cast<int>(std::sqrt(out.size() / 4 / (224 * 256)));
+    writePpm(ppm, out, 224 * scale, 256 * scale);
+  }
+  return ok ? 0 : 1;
+}
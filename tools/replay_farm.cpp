@@ -0,0 +1,296 @@
+// Replays every movie in a directory across all cores and checks the final
+// state hash of each one against the hash stored in the movie.
+//
+//   replay_farm --rom invaders.zip [--threads N] [--update] [--slowest K]
+//               [--baseline M] [--hle] [--fuse] dir
+//
+// --hle runs the hot ROM loops natively (src/hle.h), --fuse runs common
+// opcode sequences as superinstructions (src/fusion.h). Scaling
+// efficiency compares the throughput per thread with a single-thread run
+// of the first M readable movies (4 unless set, 0 skips it).
+
+#include "../src/fusion.h"
+#include "../src/hle.h"
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/threadpool.h"
+
+#include <dirent.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+enum class Status { Passed, Failed, Unverified, Recorded, Stalled, BadFile };
+
+struct Result {
+  std::string name;
+  Status status = Status::BadFile;
+  uint64_t frames = 0;
+  uint64_t hash = 0;
+  uint64_t expected = 0;
+  double seconds = 0;
+};
+
+struct WorkerStats {
+  uint64_t movies = 0;
+  uint64_t frames = 0;
+  double busy = 0; // CPU time of the worker thread
+};
+
+double threadCpuTime() {
+  timespec ts = {};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+const char *statusName(Status s) {
+  switch (s) {
+  case Status::Passed:
+    return "ok";
+  case Status::Failed:
+    return "FAIL";
+  case Status::Unverified:
+    return "no hash";
+  case Status::Recorded:
+    return "recorded";
+  case Status::Stalled:
+    return "STALLED";
+  case Status::BadFile:
+    return "BAD FILE";
+  }
+  return "?";
+}
+
+// Returns false if a half frame stalled
+bool play(Machine &m, const Movie &movie) {
+  for (const auto &in : movie.inputs) {
+    m.setInputs(in[0], in[1]);
+    if (!m.stepFrame()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<std::string> listMovies(const std::string &dir) {
+  std::vector<std::string> files;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return files;
+  }
+  while (dirent *e = readdir(d)) {
+    std::string n = e->d_name;
+    if (n.size() > 5 && n.compare(n.size() - 5, 5, ".simv") == 0) {
+      files.push_back(dir + "/" + n);
+    }
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+void usage() {
+  fprintf(stderr, "usage: replay_farm --rom <zip|dir> [--threads N] "
+                  "[--update] [--slowest K] [--baseline M] [--hle] [--fuse] "
+                  "<movie dir>\n");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string rom, dir;
+  size_t threads = std::thread::hardware_concurrency();
+  size_t slowest = 10;
+  size_t baseline = 4;
+  bool update = false;
+  bool hle = false;
+  bool fuse = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+      rom = argv[++i];
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--slowest") && i + 1 < argc) {
+      slowest = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+      baseline = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--update")) {
+      update = true;
+    } else if (!strcmp(argv[i], "--hle")) {
+      hle = true;
+    } else if (!strcmp(argv[i], "--fuse")) {
+      fuse = true;
+    } else if (argv[i][0] != '-') {
+      dir = argv[i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (rom.empty() || dir.empty()) {
+    usage();
+    return 2;
+  }
+
+  // Load the ROM once; workers copy it into their own machines
+  Machine base;
+  auto loadStart = Clock::now();
+  if (!base.loadRomPath(rom.c_str())) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom.c_str());
+    return 2;
+  }
+  double loadTime =
+      std::chrono::duration<double>(Clock::now() - loadStart).count();
+  const RomSet *set = identifyRomSet(romCrcs(*base.rom));
+  printf("ROM %s loaded in %.3f ms\n", set != nullptr ? set->name : "(unknown)",
+         loadTime * 1000);
+  if (hle) {
+    base.hle = Hle::forRom(*base.rom);
+    printf("%zu HLE routines match the ROM\n", base.hle->active.size());
+  }
+  if (fuse) {
+    base.fusion = Fusion::forRom(*base.rom);
+    size_t found = std::count_if(base.fusion->sites.begin(),
+                                 base.fusion->sites.end(),
+                                 [](uint32_t n) { return n != 0; });
+    printf("%zu fusion rules match the ROM\n", found);
+  }
+
+  std::vector<std::string> files = listMovies(dir);
+  if (files.empty()) {
+    fprintf(stderr, "no .simv movies in %s\n", dir.c_str());
+    return 2;
+  }
+
+  ThreadPool pool(threads);
+  std::vector<Machine> machines(pool.size(), base);
+  std::vector<WorkerStats> stats(pool.size());
+  std::vector<Result> results(files.size());
+
+  auto start = Clock::now();
+  pool.parallelFor(files.size(), [&](size_t i, size_t worker) {
+    auto t0 = Clock::now();
+    double cpu0 = threadCpuTime();
+    Result &r = results[i];
+    Movie movie;
+    bool loaded = movie.load(files[i]);
+    r.name = movie.name;
+    if (loaded) {
+      Machine &m = machines[worker];
+      m.reset();
+      bool ok = play(m, movie);
+
+      r.frames = m.frames;
+      r.hash = m.stateHash();
+      r.expected = movie.finalHash;
+      if (!ok) {
+        r.status = Status::Stalled;
+      } else if (movie.finalHash == 0) {
+        r.status = Status::Unverified;
+        if (update) {
+          movie.finalHash = r.hash;
+          if (movie.save(files[i])) {
+            r.status = Status::Recorded;
+          }
+        }
+      } else {
+        r.status = r.hash == movie.finalHash ? Status::Passed : Status::Failed;
+      }
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    WorkerStats &s = stats[worker];
+    s.movies++;
+    s.frames += r.frames;
+    s.busy += threadCpuTime() - cpu0;
+  });
+  double wall = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // Report
+  size_t counts[6] = {};
+  uint64_t frames = 0;
+  double busy = 0;
+  for (const auto &r : results) {
+    counts[static_cast<int>(r.status)]++;
+    frames += r.frames;
+    if (r.status == Status::Failed || r.status == Status::Stalled ||
+        r.status == Status::BadFile) {
+      printf("%-8s %s hash %016llx expected %016llx\n", statusName(r.status),
+             r.name.c_str(), static_cast<unsigned long long>(r.hash),
+             static_cast<unsigned long long>(r.expected));
+    }
+  }
+  for (const auto &s : stats) {
+    busy += s.busy;
+  }
+
+  printf("\nmovies %zu: %zu ok, %zu failed, %zu stalled, %zu unreadable, "
+         "%zu without hash, %zu recorded\n",
+         results.size(), counts[0], counts[1], counts[4], counts[5], counts[2],
+         counts[3]);
+  printf("frames %llu in %.3f s: %.0f frames/s (%.1fx real time)\n",
+         static_cast<unsigned long long>(frames), wall, frames / wall,
+         frames / wall / 60.0);
+
+  // Scaling efficiency: throughput per thread over the throughput of one
+  // thread alone, on a sample of the same movies
+  double perThread = frames / wall / pool.size();
+  printf("threads %zu: %.0f frames/s per thread", pool.size(), perThread);
+  uint64_t soloFrames = 0;
+  double soloTime = 0;
+  size_t sampled = 0;
+  Machine solo = base;
+  for (size_t i = 0; i < files.size() && sampled < baseline; ++i) {
+    Movie movie;
+    if (results[i].frames == 0 || !movie.load(files[i])) {
+      continue;
+    }
+    solo.reset();
+    auto t0 = Clock::now();
+    play(solo, movie);
+    soloTime += std::chrono::duration<double>(Clock::now() - t0).count();
+    soloFrames += solo.frames;
+    sampled++;
+  }
+  if (soloTime > 0) {
+    double fps1 = soloFrames / soloTime;
+    printf(", %.0f on one thread (%zu movies), scaling efficiency %.1f%%",
+           fps1, sampled, 100.0 * perThread / fps1);
+  }
+  // Utilisation: CPU time spent replaying vs. time the threads were there
+  printf(", utilisation %.1f%%\n", 100.0 * busy / (wall * pool.size()));
+  for (size_t w = 0; w < stats.size(); ++w) {
+    const WorkerStats &s = stats[w];
+    printf("  worker %2zu: %6llu movies %10llu frames %8.3f s busy %10.0f "
+           "frames/s\n",
+           w, static_cast<unsigned long long>(s.movies),
+           static_cast<unsigned long long>(s.frames), s.busy,
+           s.busy > 0 ? s.frames / s.busy : 0.0);
+  }
+
+  std::vector<const Result *> order;
+  for (const auto &r : results) {
+    order.push_back(&r);
+  }
+  std::sort(order.begin(), order.end(), [](const Result *a, const Result *b) {
+    return a->seconds > b->seconds;
+  });
+  order.resize(std::min(slowest, order.size()));
+  printf("slowest:\n");
+  for (const Result *r : order) {
+    printf("  %8.3f s %8llu frames %10.0f frames/s  %s\n", r->seconds,
+           static_cast<unsigned long long>(r->frames),
+           r->seconds > 0 ? r->frames / r->seconds : 0.0, r->name.c_str());
+  }
+
+  return counts[1] + counts[4] + counts[5] == 0 ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+// Takes PNG screenshots of recorded sessions in bulk. Every line of the job
+// file names a movie (.simv, played from power-on) or a saved state
+// (.sist, run on with the inputs it holds) and the frames to take, counted
+// from power-on:
+//
+//   sessions/0412.simv 600,1800,3600
+//   states/boss.sist 12000
+//
+// Jobs run across a thread pool with one Machine and SoftRenderer
+// (src/render.h) per worker; the pictures go through a bounded queue to
+// separate compressor threads that encode and write the PNGs, so
+// emulation and compression overlap. Files are <out>/<name>-<frame>.png,
+// so jobs whose files share a name (a/0412.simv and b/0412.simv) are
+// refused before anything runs rather than overwriting each other.
+//
+//   screenshots --rom invaders.zip --jobs jobs.txt --out dir [--scale S]
+//               [--threads N] [--compressors M] [--level L] [--plain]
+//
+// --plain leaves out the colour overlay.
+
+#include "../src/io.h"
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/png.h"
+#include "../src/render.h"
+#include "../src/snapshot.h"
+#include "../src/threadpool.h"
+#include "./common.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+double threadCpuTime() {
+  timespec ts = {};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Job {
+  std::string path;
+  std::vector<uint64_t> frames;
+};
+
+struct Shot {
+  std::string path;
+  std::vector<uint8_t> rgba;
+};
+
+/* Pictures waiting for a compressor. push() waits while it is full, so
+ * emulation can't run away from compression with the memory.
+ */
+struct ShotQueue {
+  explicit ShotQueue(size_t capacity) : capacity(capacity) {}
+
+  void push(Shot shot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return shots.size() < capacity; });
+    shots.push_back(std::move(shot));
+    notEmpty.notify_one();
+  }
+
+  // False once closed and empty
+  bool pop(Shot *shot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return closed || !shots.empty(); });
+    if (shots.empty()) {
+      return false;
+    }
+    *shot = std::move(shots.front());
+    shots.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+  }
+
+private:
+  size_t capacity;
+  std::mutex mutex;
+  std::condition_variable notEmpty, notFull;
+  std::deque<Shot> shots;
+  bool closed = false;
+};
+
+bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// The file name without directory and extension
+std::string stem(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string name =
+      slash == std::string::npos ? path : path.substr(slash + 1);
+  return name.substr(0, name.find_last_of('.'));
+}
+
+bool readJobs(const char *path, std::vector<Job> &jobs) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream words(line);
+    Job job;
+    std::string frames;
+    if (!(words >> job.path) || job.path[0] == '#' || !(words >> frames)) {
+      continue;
+    }
+    for (const char *p = frames.c_str(); *p != '\0';) {
+      job.frames.push_back(strtoull(p, nullptr, 10));
+      p += strcspn(p, ",");
+      p += *p == ',';
+    }
+    std::sort(job.frames.begin(), job.frames.end());
+    jobs.push_back(std::move(job));
+  }
+  return true;
+}
+
+// False, with the first clash reported, if two jobs would write the same
+// file: the same name from different directories, or the same frame twice
+bool uniqueOutputs(const std::vector<Job> &jobs) {
+  std::map<std::string, const Job *> owners;
+  for (const Job &job : jobs) {
+    auto inserted = owners.emplace(stem(job.path), &job);
+    const Job *other = inserted.first->second;
+    if (!inserted.second && other->path != job.path) {
+      fprintf(stderr, "%s and %s would write the same screenshots\n",
+              other->path.c_str(), job.path.c_str());
+      return false;
+    }
+  }
+  std::map<std::string, std::vector<uint64_t>> frames;
+  for (const Job &job : jobs) {
+    auto &taken = frames[job.path];
+    taken.insert(taken.end(), job.frames.begin(), job.frames.end());
+  }
+  for (auto &f : frames) {
+    std::sort(f.second.begin(), f.second.end());
+    auto twice = std::adjacent_find(f.second.begin(), f.second.end());
+    if (twice != f.second.end()) {
+      fprintf(stderr, "%s frame %llu is asked for twice\n", f.first.c_str(),
+              static_cast<unsigned long long>(*twice));
+      return false;
+    }
+  }
+  return true;
+}
+
+struct WorkerStats {
+  uint64_t frames = 0, shots = 0, failed = 0;
+  double busy = 0;
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *jobsPath = nullptr, *outDir = nullptr;
+  size_t threads = std::thread::hardware_concurrency();
+  size_t compressors = std::max<size_t>(1, threads / 2);
+  int level = 6;
+  SoftRenderer::Config render;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--plain")) {
+      render.overlay = false;
+    } else if (i + 1 == argc) {
+      break;
+    } else if (!strcmp(argv[i], "--rom")) {
+      rom = argv[++i];
+    } else if (!strcmp(argv[i], "--jobs")) {
+      jobsPath = argv[++i];
+    } else if (!strcmp(argv[i], "--out")) {
+      outDir = argv[++i];
+    } else if (!strcmp(argv[i], "--scale")) {
+      render.scale = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads")) {
+      threads = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--compressors")) {
+      compressors = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--level")) {
+      level = atoi(argv[++i]);
+    }
+  }
+  std::vector<Job> jobs;
+  if (rom == nullptr || jobsPath == nullptr || outDir == nullptr ||
+      threads == 0 || compressors == 0) {
+    fprintf(stderr,
+            "usage: screenshots --rom <zip|dir> --jobs jobs.txt --out dir\n"
+            "                   [--scale S] [--threads N] [--compressors M]\n"
+            "                   [--level L] [--plain]\n");
+    return 2;
+  }
+  if (!readJobs(jobsPath, jobs)) {
+    fprintf(stderr, "cannot read %s\n", jobsPath);
+    return 2;
+  }
+  if (!uniqueOutputs(jobs)) {
+    return 2;
+  }
+
+  Machine base;
+  if (!base.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  base.cpu.ports = &IoPorts::silent();
+
+  auto start = Clock::now();
+  ThreadPool pool(threads);
+  std::vector<Machine> machines(pool.size(), base);
+  std::vector<std::unique_ptr<SoftRenderer>> renderers;
+  for (size_t i = 0; i < pool.size(); ++i) {
+    renderers.emplace_back(new SoftRenderer(render));
+  }
+  const int width = renderers[0]->width(), height = renderers[0]->height();
+  std::vector<WorkerStats> workers(pool.size());
+  ShotQueue queue(4 * compressors);
+
+  // Compressors
+  std::atomic<uint64_t> pngBytes{0}, written{0}, writeFailed{0};
+  std::vector<double> compressorBusy(compressors);
+  std::vector<std::thread> compressing;
+  for (size_t c = 0; c < compressors; ++c) {
+    compressing.emplace_back([&, c] {
+      Shot shot;
+      std::vector<uint8_t> data;
+      while (queue.pop(&shot)) {
+        bool ok = png::encode(shot.rgba.data(), width, height, level, data) &&
+                  png::save(shot.path.c_str(), data);
+        (ok ? written : writeFailed)++;
+        pngBytes += ok ? data.size() : 0;
+      }
+      compressorBusy[c] = threadCpuTime();
+    });
+  }
+
+  // Emulation
+  pool.parallelFor(jobs.size(), [&](size_t i, size_t worker) {
+    double t = threadCpuTime();
+    const Job &job = jobs[i];
+    Machine &m = machines[worker];
+    SoftRenderer &r = *renderers[worker];
+    WorkerStats &stats = workers[worker];
+
+    Movie movie;
+    MachineState state;
+    bool isState = endsWith(job.path, ".sist");
+    bool loaded = isState ? state.load(job.path.c_str()) && state.applyTo(m)
+                          : movie.load(job.path);
+    if (!loaded) {
+      fprintf(stderr, "cannot use %s\n", job.path.c_str());
+      stats.failed += job.frames.size();
+      stats.busy += threadCpuTime() - t;
+      return;
+    }
+    if (!isState) {
+      m.reset();
+    }
+
+    for (uint64_t target : job.frames) {
+      bool reached = target >= m.frames;
+      while (reached && m.frames < target) {
+        if (!isState) {
+          if (m.frames >= movie.inputs.size()) {
+            reached = false;
+            break;
+          }
+          const auto &in = movie.inputs[m.frames];
+          m.setInputs(in[0], in[1]);
+        }
+        m.stepFrame();
+        stats.frames++;
+      }
+      if (!reached) {
+        fprintf(stderr, "%s has no frame %llu\n", job.path.c_str(),
+                static_cast<unsigned long long>(target));
+        stats.failed++;
+        continue;
+      }
+
+      Shot shot;
+      shot.path = std::string(outDir) + "/" + stem(job.path) + "-" +
+                  std::to_string(target) + ".png";
+      shot.rgba.resize(r.size());
+      r.render(m.vram(), shot.rgba.data());
+      stats.shots++;
+      // Waiting here for a compressor isn't emulation time
+      stats.busy += threadCpuTime() - t;
+      queue.push(std::move(shot));
+      t = threadCpuTime();
+    }
+    stats.busy += threadCpuTime() - t;
+  });
+  double emulated = since(start);
+  queue.close();
+  for (std::thread &c : compressing) {
+    c.join();
+  }
+  double wall = since(start);
+
+  WorkerStats total;
+  for (const WorkerStats &w : workers) {
+    total.frames += w.frames;
+    total.shots += w.shots;
+    total.failed += w.failed;
+    total.busy += w.busy;
+  }
+  double compressBusy = 0;
+  for (double b : compressorBusy) {
+    compressBusy += b;
+  }
+  printf("%zu jobs, %llu screenshots (%llu failed, %llu not written), "
+         "%dx%d\n",
+         jobs.size(), static_cast<unsigned long long>(written.load()),
+         static_cast<unsigned long long>(total.failed),
+         static_cast<unsigned long long>(writeFailed.load()),
+         width, height);
+  printf("%.2f s: %.1f screenshots/s, %llu frames emulated (%.0f frames/s "
+         "per busy core)\n",
+         wall, written / wall, static_cast<unsigned long long>(total.frames),
+         total.busy > 0 ? total.frames / total.busy : 0.0);
+  printf("emulation done after %.2f s on %zu threads (%.2f s busy), "
+         "compression %.2f s busy on %zu threads\n",
+         emulated, pool.size(), total.busy, compressBusy, compressors);
+  printf("%llu PNG bytes, %.0f per screenshot\n",
+         static_cast<unsigned long long>(pngBytes.load()),
+         written > 0 ? double(pngBytes) / written : 0.0);
+  return total.failed == 0 && writeFailed == 0 ? 0 : 1;
+}
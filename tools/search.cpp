@@ -0,0 +1,140 @@
+// Searches for inputs that play Space Invaders well (src/search.h): boots,
+// inserts a coin and starts a game, then runs a beam search or MCTS from
+// there over the six VecEnv actions. Reports the best score found, the
+// emulated frames per second over every thread, the states dropped as
+// duplicates and how many RAM pages the kept states share. --movie writes
+// the whole run, from power-on, as a movie replay_farm can check.
+//
+//   search --rom invaders.zip [--mode beam|mcts] [--depth D] [--hold F]
+//          [--width W] [--iterations I] [--rollout R] [--threads T]
+//          [--objective score|lives|played] [--seed S] [--movie out.simv]
+
+#include "../src/io.h"
+#include "../src/movie.h"
+#include "../src/search.h"
+#include "../src/snapshot.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+constexpr uint16_t gameMode = 0x20ef; // 1 while a game is being played
+constexpr uint8_t coin = 0b00000001;
+constexpr uint8_t start1 = 0b00000100;
+constexpr uint8_t read1Default = 0b10000011;
+constexpr int bootFrames = 120;
+
+void hold(Machine &m, Movie &movie, uint8_t bits, int frames) {
+  for (int i = 0; i < frames; ++i) {
+    m.setInputs(bits, read1Default);
+    movie.inputs.push_back({bits, read1Default});
+    m.stepFrame();
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *mode = "beam", *objective = "played";
+  const char *moviePath = nullptr;
+  Search::Config config;
+  config.choices = Search::invadersChoices();
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--mode")) {
+      mode = argv[i + 1];
+    } else if (!strcmp(argv[i], "--depth")) {
+      config.depth = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--hold")) {
+      config.framesPerChoice = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--width")) {
+      config.width = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--iterations")) {
+      config.iterations = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--rollout")) {
+      config.rollout = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--threads")) {
+      config.threads = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--objective")) {
+      objective = argv[i + 1];
+    } else if (!strcmp(argv[i], "--seed")) {
+      config.seed = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    }
+  }
+  Search::Objective score = !strcmp(objective, "score") ? objectives::score
+                            : !strcmp(objective, "lives")
+                                ? objectives::lives
+                                : objectives::played;
+  bool mcts = !strcmp(mode, "mcts");
+  if (rom == nullptr || config.threads == 0 || config.framesPerChoice < 1) {
+    fprintf(stderr,
+            "usage: search --rom <zip|dir> [--mode beam|mcts] [--depth D]\n"
+            "              [--hold F] [--width W] [--iterations I]\n"
+            "              [--rollout R] [--threads T] [--seed S]\n"
+            "              [--objective score|lives|played] "
+            "[--movie out.simv]\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  m.cpu.ports = &IoPorts::silent();
+
+  // Every frame from power-on goes into the movie
+  Movie movie;
+  movie.name = moviePath != nullptr ? moviePath : "";
+  m.reset();
+  bootState(m, bootFrames)->applyTo(m);
+  movie.inputs.assign(bootFrames, {0, read1Default});
+  hold(m, movie, coin, 4);
+  hold(m, movie, 0, 30);
+  hold(m, movie, start1, 4);
+  for (int i = 0; i < 600 && m.cpu.read(gameMode) != 1; ++i) {
+    hold(m, movie, 0, 1);
+  }
+  size_t startFrames = movie.inputs.size();
+
+  Search search(m, config, score);
+  Search::Result r = mcts ? search.mcts() : search.beam();
+  auto found = search.inputs(r);
+  movie.inputs.insert(movie.inputs.end(), found.begin(), found.end());
+
+  printf("%s from frame %zu: %zu choices of %d frames, %s %.0f\n", mode,
+         startFrames, r.choices.size(), config.framesPerChoice, objective,
+         r.score);
+  printf("%llu frames in %.2f s, %.0f frames/s on %zu threads\n",
+         static_cast<unsigned long long>(r.frames), r.seconds,
+         r.frames / r.seconds, config.threads);
+  printf("%llu states, %llu duplicates dropped\n",
+         static_cast<unsigned long long>(r.states),
+         static_cast<unsigned long long>(r.duplicates));
+  printf("%zu RAM pages held at the end\n", r.pages);
+
+  if (moviePath != nullptr) {
+    // Replay from power-on, to check the search reached what it reports
+    m.reset();
+    for (const auto &in : movie.inputs) {
+      m.setInputs(in[0], in[1]);
+      m.stepFrame();
+    }
+    movie.finalHash = m.stateHash();
+    if (score(m) != r.score) {
+      fprintf(stderr, "replay scores %.0f, not %.0f\n", score(m), r.score);
+      return 1;
+    }
+    if (!movie.save(moviePath)) {
+      fprintf(stderr, "cannot write %s\n", moviePath);
+      return 1;
+    }
+    printf("wrote %zu frames to %s\n", movie.inputs.size(), moviePath);
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Runs the game headless and records its sound to a .wav file. Inputs come
+// from a movie, or the machine just runs the attract mode.
+//
+//   sound_dump --rom invaders.zip --out sound.wav [--movie m.simv]
+//              [--frames N] [--samples dir]
+
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/sound.h"
+#include "../src/wav.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *out = nullptr, *moviePath = nullptr;
+  const char *samples = nullptr;
+  uint64_t frames = 3600;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--out")) {
+      out = argv[i + 1];
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = strtoull(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--samples")) {
+      samples = argv[i + 1];
+    }
+  }
+  if (rom == nullptr || out == nullptr) {
+    fprintf(stderr, "usage: sound_dump --rom <zip|dir> --out <file.wav> "
+                    "[--movie m.simv] [--frames N] [--samples dir]\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  Movie movie;
+  if (moviePath != nullptr) {
+    if (!movie.load(moviePath)) {
+      fprintf(stderr, "cannot read %s\n", moviePath);
+      return 2;
+    }
+    frames = movie.inputs.size();
+  }
+
+  Sound sound;
+  if (samples != nullptr) {
+    printf("%d samples loaded from %s\n", sound.loadSamples(samples), samples);
+  }
+  WavWriter wav;
+  if (!wav.open(out, Sound::sampleRate)) {
+    fprintf(stderr, "cannot write %s\n", out);
+    return 2;
+  }
+
+  // The writer thread is the ring's consumer, like an audio device would be
+  std::atomic<bool> running{true};
+  std::thread writer([&] {
+    int16_t buf[1024];
+    for (;;) {
+      size_t n = sound.ring.pop(buf, sizeof(buf) / sizeof(buf[0]));
+      if (n > 0) {
+        wav.write(buf, n);
+      } else if (!running.load()) {
+        break;
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+
+  m.reset();
+  m.cpu.sound = &sound;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t f = 0; f < frames; ++f) {
+    if (moviePath != nullptr) {
+      m.setInputs(movie.inputs[f][0], movie.inputs[f][1]);
+    }
+    m.stepFrame();
+    // No real-time device to pace us: wait for the writer instead of
+    // overrunning the ring
+    while (sound.ring.size() > sound.ring.capacity() / 2) {
+      std::this_thread::yield();
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  running = false;
+  writer.join();
+  wav.close();
+
+  Sound::Stats st = sound.stats();
+  printf("%llu frames in %.2f s (%.0fx real time)\n",
+         static_cast<unsigned long long>(frames), seconds,
+         frames / 60.0 / seconds);
+  printf("%llu sound edges, %llu samples (%.2f s) written, %llu dropped\n",
+         static_cast<unsigned long long>(st.edges),
+         static_cast<unsigned long long>(wav.samples),
+         wav.samples / static_cast<double>(Sound::sampleRate),
+         static_cast<unsigned long long>(st.dropped));
+  return st.dropped == 0 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Runs the same random inputs on the interpreter and on StaticInvaders,
+// compares their state hashes and counters after every frame and reports
+// the speed of both. Build it with the file tools/recompile.cpp wrote for
+// the ROM.
+//
+//   static_check --rom invaders.zip [--frames F] [--seed S]
+
+#include "../src/static_invaders.h"
+#include "./common.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr;
+  int frames = 3600;
+  unsigned seed = 1;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seed")) {
+      seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+  }
+  if (rom == nullptr) {
+    fprintf(stderr,
+            "usage: static_check --rom <zip|dir> [--frames F] [--seed S]\n");
+    return 2;
+  }
+
+  Machine interpreted;
+  if (!interpreted.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  Machine translated = interpreted;
+  StaticInvaders core(translated);
+  if (!core.translated) {
+    fprintf(stderr, "%s isn't the ROM the static code was generated from\n",
+            rom);
+    return 2;
+  }
+  printf("%u blocks\n", staticcode::blocks);
+
+  Differential d;
+  d.test = {&translated};
+  d.reference = {&interpreted};
+  d.step = [&] { return core.stepFrame(); };
+  if (!d.run(frames, seed)) {
+    return 1;
+  }
+
+  printf("%d frames match, %llu instructions interpreted\n", frames,
+         static_cast<unsigned long long>(core.interpreted));
+  printf("static %.0f frames/s, interpreter %.0f frames/s\n",
+         frames / d.testTime, frames / d.referenceTime);
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Records a binary execution trace (src/trace.h) of a movie or of the
+// attract mode.
+//
+//   trace --rom invaders.zip --out run.sitr [--movie m.simv] [--frames N]
+
+#include "../src/machine.h"
+#include "../src/movie.h"
+#include "../src/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv) {
+  const char *rom = nullptr, *out = nullptr, *moviePath = nullptr;
+  uint64_t frames = 600;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--out")) {
+      out = argv[i + 1];
+    } else if (!strcmp(argv[i], "--movie")) {
+      moviePath = argv[i + 1];
+    } else if (!strcmp(argv[i], "--frames")) {
+      frames = strtoull(argv[i + 1], nullptr, 10);
+    }
+  }
+  if (rom == nullptr || out == nullptr) {
+    fprintf(stderr, "usage: trace --rom <zip|dir> --out <file.sitr> "
+                    "[--movie m.simv] [--frames N]\n");
+    return 2;
+  }
+
+  Machine m;
+  if (!m.loadRomPath(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  Movie movie;
+  if (moviePath != nullptr) {
+    if (!movie.load(moviePath)) {
+      fprintf(stderr, "cannot read %s\n", moviePath);
+      return 2;
+    }
+    frames = std::min<uint64_t>(frames, movie.inputs.size());
+  }
+
+  Tracer tracer;
+  if (!tracer.open(out)) {
+    fprintf(stderr, "cannot write %s\n", out);
+    return 2;
+  }
+  m.reset();
+  m.cpu.hooks = &tracer;
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t f = 0; f < frames; ++f) {
+    if (moviePath != nullptr) {
+      m.setInputs(movie.inputs[f][0], movie.inputs[f][1]);
+    }
+    m.stepFrame();
+  }
+  bool ok = tracer.close();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  printf("%llu records, %llu bytes (%.2f per record), %.2f s, "
+         "%llu waits for the writer\n",
+         static_cast<unsigned long long>(tracer.records),
+         static_cast<unsigned long long>(tracer.bytes.load()),
+         tracer.records != 0 ? static_cast<double>(tracer.bytes) / tracer.records
+                             : 0.0,
+         seconds, static_cast<unsigned long long>(tracer.waits));
+  if (m.cpu.unimplemented != 0) {
+    printf("%llu unimplemented opcodes executed, last %02x\n",
+           static_cast<unsigned long long>(m.cpu.unimplemented),
+           m.cpu.lastUnimplemented);
+  }
+  return ok ? 0 : 1;
+}
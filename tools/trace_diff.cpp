@@ -0,0 +1,218 @@
+// Decodes execution traces and compares them, stopping at the first
+// instruction where they diverge.
+//
+//   trace_diff --print [--limit N] a.sitr
+//   trace_diff [--context N] [--flags-mask M] a.sitr b.(sitr|txt)
+//
+// Either side can be a binary trace from tools/trace or a text trace, e.g.
+// from another 8080 emulator: one instruction per line, "KEY:hex" fields
+// in any order out of PC SP OP A B C D E H L F CYC. Fields missing from
+// either side aren't compared. --print writes that text format.
+//
+// The flags are compared through a mask, 0xc5 (S Z P CY) by default since
+// this core doesn't implement the auxiliary carry.
+
+#include "../src/disasm.h"
+#include "../src/trace.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+namespace {
+enum Field { PC, SP, OP, A, B, C, D, E, H, L, F, CYC, FieldCount };
+const char *fieldNames[FieldCount] = {"PC", "SP", "OP", "A", "B", "C",
+                                      "D",  "E",  "H",  "L", "F", "CYC"};
+
+struct Row {
+  uint32_t value[FieldCount] = {};
+  uint32_t present = 0; // bit per field
+};
+
+Row fromRecord(const TraceRecord &r) {
+  Row row;
+  uint32_t v[FieldCount] = {r.pc, r.sp, r.op, r.A, r.B, r.C,
+                            r.D,  r.E,  r.H,  r.L, r.psw, r.cycles};
+  memcpy(row.value, v, sizeof(v));
+  row.present = (1u << FieldCount) - 1;
+  return row;
+}
+
+// A binary or text trace
+struct Source {
+  TraceReader binary;
+  FILE *text = nullptr;
+  uint64_t line = 0;
+
+  ~Source() {
+    if (text != nullptr) {
+      fclose(text);
+    }
+  }
+
+  bool open(const char *path) {
+    if (binary.open(path)) {
+      return true;
+    }
+    text = fopen(path, "r");
+    return text != nullptr;
+  }
+
+  bool next(Row &row) {
+    if (text == nullptr) {
+      TraceRecord r;
+      if (!binary.next(r)) {
+        return false;
+      }
+      row = fromRecord(r);
+      return true;
+    }
+
+    char buf[512];
+    while (fgets(buf, sizeof(buf), text) != nullptr) {
+      line++;
+      row = Row();
+      for (char *tok = strtok(buf, " \t\r\n,"); tok != nullptr;
+           tok = strtok(nullptr, " \t\r\n,")) {
+        char *colon = strchr(tok, ':');
+        if (colon == nullptr) {
+          continue;
+        }
+        *colon = '\0';
+        for (int f = 0; f < FieldCount; ++f) {
+          if (strcasecmp(tok, fieldNames[f]) == 0) {
+            row.value[f] = strtoul(colon + 1, nullptr, 16);
+            row.present |= 1u << f;
+          }
+        }
+      }
+      if (row.present != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+void print(FILE *out, uint64_t index, const Row &row) {
+  fprintf(out, "%10llu", static_cast<unsigned long long>(index));
+  for (int f = 0; f < FieldCount; ++f) {
+    if ((row.present >> f) & 1) {
+      fprintf(out, f == PC || f == SP ? " %s:%04x" : " %s:%02x", fieldNames[f],
+              row.value[f]);
+    }
+  }
+  if ((row.present >> OP) & 1) {
+    const disasm::Opcode &o = disasm::opcode(row.value[OP]);
+    std::string name = o.format;
+    fprintf(out, "  %s", name.substr(0, name.find(' ')).c_str());
+  }
+  fputc('\n', out);
+}
+
+void usage() {
+  fprintf(stderr, "usage: trace_diff --print [--limit N] a.sitr\n"
+                  "       trace_diff [--context N] [--flags-mask M] "
+                  "a.(sitr|txt) b.(sitr|txt)\n");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *paths[2] = {nullptr, nullptr};
+  int files = 0;
+  bool printOnly = false;
+  uint64_t limit = ~0ull;
+  size_t context = 8;
+  uint32_t flagsMask = 0xc5;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--print")) {
+      printOnly = true;
+    } else if (!strcmp(argv[i], "--limit") && i + 1 < argc) {
+      limit = strtoull(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--context") && i + 1 < argc) {
+      context = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--flags-mask") && i + 1 < argc) {
+      flagsMask = strtoul(argv[++i], nullptr, 16);
+    } else if (argv[i][0] != '-' && files < 2) {
+      paths[files++] = argv[i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (files != (printOnly ? 1 : 2)) {
+    usage();
+    return 2;
+  }
+
+  Source a, b;
+  for (int i = 0; i < files; ++i) {
+    if (!(i == 0 ? a : b).open(paths[i])) {
+      fprintf(stderr, "cannot read %s\n", paths[i]);
+      return 2;
+    }
+  }
+
+  Row ra, rb;
+  if (printOnly) {
+    for (uint64_t i = 0; i < limit && a.next(ra); ++i) {
+      print(stdout, i, ra);
+    }
+    return 0;
+  }
+
+  // The instructions leading up to a divergence
+  std::deque<Row> history;
+  for (uint64_t i = 0;; ++i) {
+    bool moreA = a.next(ra);
+    bool moreB = b.next(rb);
+    if (!moreA || !moreB) {
+      if (moreA != moreB) {
+        printf("%s ends after %llu instructions, the other one goes on\n",
+               moreA ? paths[1] : paths[0],
+               static_cast<unsigned long long>(i));
+        return 1;
+      }
+      printf("%llu instructions, no divergence\n",
+             static_cast<unsigned long long>(i));
+      return 0;
+    }
+
+    uint32_t both = ra.present & rb.present;
+    uint32_t differ = 0;
+    for (int f = 0; f < FieldCount; ++f) {
+      uint32_t m = f == F ? flagsMask : ~0u;
+      if (((both >> f) & 1) && (ra.value[f] & m) != (rb.value[f] & m)) {
+        differ |= 1u << f;
+      }
+    }
+
+    if (differ != 0) {
+      printf("diverges at instruction %llu:", static_cast<unsigned long long>(i));
+      for (int f = 0; f < FieldCount; ++f) {
+        if ((differ >> f) & 1) {
+          printf(" %s", fieldNames[f]);
+        }
+      }
+      printf("\n\nbefore (%s):\n", paths[0]);
+      uint64_t first = i - history.size();
+      for (size_t k = 0; k < history.size(); ++k) {
+        print(stdout, first + k, history[k]);
+      }
+      printf("\n%s:\n", paths[0]);
+      print(stdout, i, ra);
+      printf("%s:\n", paths[1]);
+      print(stdout, i, rb);
+      return 1;
+    }
+
+    history.push_back(ra);
+    if (history.size() > context) {
+      history.pop_front();
+    }
+  }
+}
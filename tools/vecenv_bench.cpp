@@ -0,0 +1,79 @@
+// Steps a VecEnv with random actions and reports steps per second per core.
+//
+//   vecenv_bench --rom invaders.zip [--envs N] [--threads T]
+//                [--downsample D] [--frameskip F] [--seconds S]
+
+#include "../src/vecenv.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+  VecEnv::Config config;
+  const char *rom = nullptr;
+  double seconds = 5;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--rom")) {
+      rom = argv[i + 1];
+    } else if (!strcmp(argv[i], "--envs")) {
+      config.envs = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--threads")) {
+      config.threads = strtoul(argv[i + 1], nullptr, 10);
+    } else if (!strcmp(argv[i], "--downsample")) {
+      config.downsample = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--frameskip")) {
+      config.frameskip = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seconds")) {
+      seconds = atof(argv[i + 1]);
+    }
+  }
+  if (rom == nullptr || config.envs <= 0) {
+    fprintf(stderr, "usage: vecenv_bench --rom <zip|dir> [--envs N] "
+                    "[--threads T] [--downsample D] [--frameskip F] "
+                    "[--seconds S]\n");
+    return 2;
+  }
+
+  VecEnv env(config);
+  if (!env.loadRom(rom)) {
+    fprintf(stderr, "cannot load ROM from %s\n", rom);
+    return 2;
+  }
+  printf("first playable frame after %.1f ms\n", env.startupSeconds * 1000);
+
+  std::vector<uint8_t> obs(config.envs * env.observationSize());
+  std::vector<int32_t> actions(config.envs);
+  std::vector<float> rewards(config.envs);
+  std::vector<uint8_t> done(config.envs);
+  std::mt19937 rng(1);
+
+  env.reset(obs.data());
+  uint64_t episodes = 0;
+  double reward = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count() < seconds) {
+    for (auto &a : actions) {
+      a = rng() % VecEnv::ActionCount;
+    }
+    env.step(actions.data(), obs.data(), rewards.data(), done.data());
+    for (int i = 0; i < config.envs; ++i) {
+      reward += rewards[i];
+      episodes += done[i];
+    }
+  }
+
+  printf("%llu steps, %llu episodes, %.0f points\n",
+         static_cast<unsigned long long>(env.steps()),
+         static_cast<unsigned long long>(episodes), reward);
+  printf("%.0f steps/s per core (%d frames per step, %dx%d observations)\n",
+         env.stepsPerSecondPerCore(), config.frameskip,
+         env.observationRows(), env.observationCols());
+  return 0;
+}